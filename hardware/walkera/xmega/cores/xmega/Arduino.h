@@ -39,6 +39,7 @@
 #include <avr/interrupt.h>
 
 #include "binary.h"
+#include "wiring_dma.h"
 
 #ifdef __cplusplus
 extern "C"{
@@ -160,6 +161,60 @@ int analogRead(uint8_t);
 void analogReference(uint8_t mode); // somewhat different for xmega (default is Vcc/2)
 void analogWrite(uint8_t, int);
 
+// 16-bit PWM on TCC0 (PC0-PC3), TCC1 (PC4-PC5) and TCD1 (PD4-PD5), implemented in wiring_analog.c
+// 'analogWriteFrequency' returns the actual frequency, or zero if the pin has no 16-bit timer
+// NOTE:  TCC0 leaves split mode for this, so 'analogWrite' on PC6-PC7 (and PC4-PC5 without TCC1) is ON/OFF
+void analogWriteResolution(uint8_t bits); // resolution of 'analogWrite16' values, 1-16 (default 8)
+unsigned long analogWriteFrequency(uint8_t pin, unsigned long frequency);
+void analogWrite16(uint8_t pin, uint16_t val);
+TC0_t *digitalPinToTimer16(uint8_t pin, uint8_t *pChannel); // TC1_t timers are returned as TC0_t
+
+// Hi-Res extension - 4 times the PWM resolution (and 4 times the PER for a given frequency)
+// 'analogWriteHiRes' keeps the frequency of a running timer.  Both return zero on failure
+uint8_t analogWriteHiRes(uint8_t pin, uint8_t bEnable);
+uint8_t timer16HiRes(TC0_t *port, uint8_t bEnable);
+unsigned long timer16TickRate(TC0_t *port); // PER/CCx ticks per second, including Hi-Res
+
+// timers that several parts of the core (and libraries) use for something other than PWM, like
+// TCE0 on boards where PORTE has no PWM pins.  'init()' may have started the timer, so it is the
+// owner that counts, not CLKSEL.  'timerClaim' returns zero if another owner has the timer, and
+// non-zero if it was free or 'owner' already had it.  implemented in wiring.c
+#define TIMER_OWNER_NONE        0
+#define TIMER_OWNER_TONE        1 /* 'tone()' */
+#define TIMER_OWNER_SOFTPWM     2 /* 'softPWMBegin()' */
+#define TIMER_OWNER_SOFTSERIAL  3 /* the SoftwareSerial library */
+#define TIMER_OWNER_AUTOBAUD    4 /* 'Serial.beginAuto()' */
+
+uint8_t timerClaim(TC0_t *port, uint8_t owner);
+void timerRelease(TC0_t *port, uint8_t owner); // does nothing unless 'owner' has the timer
+uint8_t timerOwner(TC0_t *port); // TIMER_OWNER_NONE if nobody has it
+
+// DMA-driven software PWM on one port, implemented in wiring_softpwm.c
+// after 'softPWMBegin', 'analogWrite' on any pin of that port uses it
+uint8_t softPWMBegin(PORT_t *port, uint8_t steps, unsigned long frequency); // returns zero on failure
+void softPWMEnd(void);
+uint8_t softPWMWrite(uint8_t pin, uint8_t val); // returns zero if 'pin' is not on the software PWM port
+
+// analog comparators on PORTA (ACA), implemented in wiring_comparator.c
+// inputs are analog pins (A0-A7 or 0-7) or one of the AC_INPUT_ values; the functions return zero on failure
+#define AC_INPUT_DAC      0x80 /* positive or negative input */
+#define AC_INPUT_BANDGAP  0x81 /* negative input only */
+#define AC_INPUT_SCALER   0x82 /* negative input only - Vcc * (scale + 1) / 64, see analogComparatorScaler */
+
+#define AC_HYSTERESIS_NONE  0
+#define AC_HYSTERESIS_SMALL 1
+#define AC_HYSTERESIS_LARGE 2
+
+uint8_t analogComparatorBegin(uint8_t comparator, uint8_t posInput, uint8_t negInput, uint8_t hysteresis);
+void analogComparatorEnd(uint8_t comparator);
+void analogComparatorScaler(uint8_t scale); // 0-63
+uint8_t analogComparatorRead(uint8_t comparator); // HIGH when the positive input is higher
+void analogComparatorAttachInterrupt(uint8_t comparator, void (*)(void), int mode); // RISING, FALLING, or CHANGE
+void analogComparatorDetachInterrupt(uint8_t comparator);
+uint8_t analogComparatorFault(uint8_t comparator, uint8_t eventChannel, uint8_t pinMask, uint8_t latched); // AWEXC fault on PORTC pins
+void analogComparatorFaultClear(void);
+void analogComparatorFaultEnd(void);
+
 unsigned long millis(void);
 unsigned long micros(void);
 void delay(unsigned long);
@@ -42,6 +42,7 @@
 #define SERIAL_0_USART_DATA USARTD0_DATA
 #define SERIAL_0_RXC_ISR ISR(USARTD0_RXC_vect)
 #define SERIAL_0_DRE_ISR ISR(USARTD0_DRE_vect)
+#define SERIAL_0_TXC_ISR ISR(USARTD0_TXC_vect)
 #define USARTD0_VECTOR_EXISTS
 #define SERIAL_0_RX_PIN_INDEX 2
 #define SERIAL_0_TX_PIN_INDEX 3
@@ -59,6 +60,7 @@
 #define SERIAL_1_USART_DATA USARTC0_DATA
 #define SERIAL_1_RXC_ISR ISR(USARTC0_RXC_vect)
 #define SERIAL_1_DRE_ISR ISR(USARTC0_DRE_vect)
+#define SERIAL_1_TXC_ISR ISR(USARTC0_TXC_vect)
 #define USARTC0_VECTOR_EXISTS
 #define SERIAL_1_RX_PIN_INDEX 2
 #define SERIAL_1_TX_PIN_INDEX 3
@@ -89,7 +91,6 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // NOTE:  in some cases I might want to override this.  It's now "overrideable" in 'pins_arduino.h'
-// TODO:  support var length buffers from a pre-allocated linked list?  as an option?
 #ifndef SERIAL_BUFFER_SIZE
 
 #if !defined(SERIAL_2_PORT_NAME) && !defined(SERIAL_3_PORT_NAME) && !defined(SERIAL_4_PORT_NAME) && !defined(SERIAL_5_PORT_NAME) && !defined(SERIAL_6_PORT_NAME) && !defined(SERIAL_7_PORT_NAME)
@@ -105,6 +106,135 @@
 
 #endif // SERIAL_BUFFER_SIZE
 
+// Each port and direction can have its own size.  Define 'SERIAL_n_RX_BUFFER_SIZE' and/or
+// 'SERIAL_n_TX_BUFFER_SIZE' in 'pins_arduino.h' (n is the same as in 'SERIAL_n_PORT_NAME'),
+// otherwise it's 'SERIAL_BUFFER_SIZE'.  Sizes MUST be a power of 2, so that the index can
+// wrap around with a mask instead of a (slow) division.  A 16-byte debug port and a 256-byte
+// GPS port only cost what they need, and 'begin(baud, config, rx, tx)' can change it later.
+
+#ifndef SERIAL_0_RX_BUFFER_SIZE
+#define SERIAL_0_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_0_RX_BUFFER_SIZE
+#ifndef SERIAL_0_TX_BUFFER_SIZE
+#define SERIAL_0_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_0_TX_BUFFER_SIZE
+
+#ifndef SERIAL_1_RX_BUFFER_SIZE
+#define SERIAL_1_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_1_RX_BUFFER_SIZE
+#ifndef SERIAL_1_TX_BUFFER_SIZE
+#define SERIAL_1_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_1_TX_BUFFER_SIZE
+
+#ifndef SERIAL_2_RX_BUFFER_SIZE
+#define SERIAL_2_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_2_RX_BUFFER_SIZE
+#ifndef SERIAL_2_TX_BUFFER_SIZE
+#define SERIAL_2_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_2_TX_BUFFER_SIZE
+
+#ifndef SERIAL_3_RX_BUFFER_SIZE
+#define SERIAL_3_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_3_RX_BUFFER_SIZE
+#ifndef SERIAL_3_TX_BUFFER_SIZE
+#define SERIAL_3_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_3_TX_BUFFER_SIZE
+
+#ifndef SERIAL_4_RX_BUFFER_SIZE
+#define SERIAL_4_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_4_RX_BUFFER_SIZE
+#ifndef SERIAL_4_TX_BUFFER_SIZE
+#define SERIAL_4_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_4_TX_BUFFER_SIZE
+
+#ifndef SERIAL_5_RX_BUFFER_SIZE
+#define SERIAL_5_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_5_RX_BUFFER_SIZE
+#ifndef SERIAL_5_TX_BUFFER_SIZE
+#define SERIAL_5_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_5_TX_BUFFER_SIZE
+
+#ifndef SERIAL_6_RX_BUFFER_SIZE
+#define SERIAL_6_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_6_RX_BUFFER_SIZE
+#ifndef SERIAL_6_TX_BUFFER_SIZE
+#define SERIAL_6_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_6_TX_BUFFER_SIZE
+
+#ifndef SERIAL_7_RX_BUFFER_SIZE
+#define SERIAL_7_RX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_7_RX_BUFFER_SIZE
+#ifndef SERIAL_7_TX_BUFFER_SIZE
+#define SERIAL_7_TX_BUFFER_SIZE SERIAL_BUFFER_SIZE
+#endif // SERIAL_7_TX_BUFFER_SIZE
+
+// the largest buffer size, including sizes passed to 'begin()'.  Up to 256 the index
+// is an unsigned char (it's faster, smaller), otherwise it's an unsigned int
+#ifndef SERIAL_BUFFER_MAX
+#define SERIAL_BUFFER_MAX 256
+#endif // SERIAL_BUFFER_MAX
+
+#if (SERIAL_0_RX_BUFFER_SIZE & (SERIAL_0_RX_BUFFER_SIZE - 1)) || SERIAL_0_RX_BUFFER_SIZE < 2 || SERIAL_0_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_0_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_0_RX_BUFFER_SIZE
+#if (SERIAL_0_TX_BUFFER_SIZE & (SERIAL_0_TX_BUFFER_SIZE - 1)) || SERIAL_0_TX_BUFFER_SIZE < 2 || SERIAL_0_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_0_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_0_TX_BUFFER_SIZE
+#if (SERIAL_1_RX_BUFFER_SIZE & (SERIAL_1_RX_BUFFER_SIZE - 1)) || SERIAL_1_RX_BUFFER_SIZE < 2 || SERIAL_1_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_1_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_1_RX_BUFFER_SIZE
+#if (SERIAL_1_TX_BUFFER_SIZE & (SERIAL_1_TX_BUFFER_SIZE - 1)) || SERIAL_1_TX_BUFFER_SIZE < 2 || SERIAL_1_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_1_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_1_TX_BUFFER_SIZE
+#ifdef SERIAL_2_PORT_NAME
+#if (SERIAL_2_RX_BUFFER_SIZE & (SERIAL_2_RX_BUFFER_SIZE - 1)) || SERIAL_2_RX_BUFFER_SIZE < 2 || SERIAL_2_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_2_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_2_RX_BUFFER_SIZE
+#if (SERIAL_2_TX_BUFFER_SIZE & (SERIAL_2_TX_BUFFER_SIZE - 1)) || SERIAL_2_TX_BUFFER_SIZE < 2 || SERIAL_2_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_2_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_2_TX_BUFFER_SIZE
+#endif // SERIAL_2_PORT_NAME
+#ifdef SERIAL_3_PORT_NAME
+#if (SERIAL_3_RX_BUFFER_SIZE & (SERIAL_3_RX_BUFFER_SIZE - 1)) || SERIAL_3_RX_BUFFER_SIZE < 2 || SERIAL_3_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_3_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_3_RX_BUFFER_SIZE
+#if (SERIAL_3_TX_BUFFER_SIZE & (SERIAL_3_TX_BUFFER_SIZE - 1)) || SERIAL_3_TX_BUFFER_SIZE < 2 || SERIAL_3_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_3_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_3_TX_BUFFER_SIZE
+#endif // SERIAL_3_PORT_NAME
+#ifdef SERIAL_4_PORT_NAME
+#if (SERIAL_4_RX_BUFFER_SIZE & (SERIAL_4_RX_BUFFER_SIZE - 1)) || SERIAL_4_RX_BUFFER_SIZE < 2 || SERIAL_4_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_4_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_4_RX_BUFFER_SIZE
+#if (SERIAL_4_TX_BUFFER_SIZE & (SERIAL_4_TX_BUFFER_SIZE - 1)) || SERIAL_4_TX_BUFFER_SIZE < 2 || SERIAL_4_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_4_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_4_TX_BUFFER_SIZE
+#endif // SERIAL_4_PORT_NAME
+#ifdef SERIAL_5_PORT_NAME
+#if (SERIAL_5_RX_BUFFER_SIZE & (SERIAL_5_RX_BUFFER_SIZE - 1)) || SERIAL_5_RX_BUFFER_SIZE < 2 || SERIAL_5_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_5_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_5_RX_BUFFER_SIZE
+#if (SERIAL_5_TX_BUFFER_SIZE & (SERIAL_5_TX_BUFFER_SIZE - 1)) || SERIAL_5_TX_BUFFER_SIZE < 2 || SERIAL_5_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_5_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_5_TX_BUFFER_SIZE
+#endif // SERIAL_5_PORT_NAME
+#ifdef SERIAL_6_PORT_NAME
+#if (SERIAL_6_RX_BUFFER_SIZE & (SERIAL_6_RX_BUFFER_SIZE - 1)) || SERIAL_6_RX_BUFFER_SIZE < 2 || SERIAL_6_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_6_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_6_RX_BUFFER_SIZE
+#if (SERIAL_6_TX_BUFFER_SIZE & (SERIAL_6_TX_BUFFER_SIZE - 1)) || SERIAL_6_TX_BUFFER_SIZE < 2 || SERIAL_6_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_6_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_6_TX_BUFFER_SIZE
+#endif // SERIAL_6_PORT_NAME
+#ifdef SERIAL_7_PORT_NAME
+#if (SERIAL_7_RX_BUFFER_SIZE & (SERIAL_7_RX_BUFFER_SIZE - 1)) || SERIAL_7_RX_BUFFER_SIZE < 2 || SERIAL_7_RX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_7_RX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_7_RX_BUFFER_SIZE
+#if (SERIAL_7_TX_BUFFER_SIZE & (SERIAL_7_TX_BUFFER_SIZE - 1)) || SERIAL_7_TX_BUFFER_SIZE < 2 || SERIAL_7_TX_BUFFER_SIZE > SERIAL_BUFFER_MAX
+#error SERIAL_7_TX_BUFFER_SIZE must be a power of 2, from 2 to SERIAL_BUFFER_MAX
+#endif // SERIAL_7_TX_BUFFER_SIZE
+#endif // SERIAL_7_PORT_NAME
+
 //////////////////////////////////////////////////////////////////////////////
 //                                                                          //
 //            _                 _              __   __                      //
@@ -116,58 +246,276 @@
 //                                                                          //
 //////////////////////////////////////////////////////////////////////////////
 
+#if SERIAL_BUFFER_MAX <= 256
+typedef uint8_t serial_index_t;
+#else // SERIAL_BUFFER_MAX > 256
+typedef unsigned int serial_index_t;
+#endif // SERIAL_BUFFER_MAX
+
+#define SERIAL_FRAME_MAX 8 /* frames that can wait for 'readFrame()', must be a power of 2 */
+#define SERIAL_RX_BURST_MAX 4 /* bytes per 'onReceive()' call - the USART holds 2, plus what arrives meanwhile */
+
+// gap framing for an RX buffer - see 'HardwareSerial::setFrameGap()'.  A queue of frame starts
+// (buffer position and time of the first byte), filled by the RXC ISR, emptied by 'readFrame()'
+typedef struct _SERIAL_FRAME_
+{
+  unsigned long ulGap;                // a gap longer than this (in us) starts a new frame
+  unsigned long ulLast;               // 'micros()' at the last byte
+  volatile uint8_t bHead, bTail;
+  serial_index_t pos[SERIAL_FRAME_MAX];
+  unsigned long time[SERIAL_FRAME_MAX];
+} SERIAL_FRAME;
+
 struct ring_buffer
 {
-  unsigned char buffer[SERIAL_BUFFER_SIZE];
-#if SERIAL_BUFFER_SIZE < 256
-  // when buffer size is less than 256 bytes, use an unsigned char (it's faster, smaller)
-  volatile uint8_t/*unsigned int*/ head;
-  volatile uint8_t/*unsigned int*/ tail;
-#else  // SERIAL_BUFFER_SIZE >= 256
-  volatile unsigned int head;
-  volatile unsigned int tail;
-#endif // SERIAL_BUFFER_SIZE
+  unsigned char *buffer;          // the static buffer, or one from 'malloc()' when 'begin()' asked for more
+  volatile serial_index_t head;
+  volatile serial_index_t tail;
+  serial_index_t mask;            // buffer size - 1 (the size is a power of 2)
+  unsigned char *static_buffer;   // the compile-time buffer for this port
+  serial_index_t static_mask;     // and its size - 1
+  SERIAL_FRAME *frame;            // gap framing (RX only), NULL when off
+  unsigned char *bit9;            // 9-bit frames (RX only) - RXB8 for each byte, 1 bit per byte, NULL when off
 };
 
+#define RING_BUFFER_INIT(X) { X, 0, 0, sizeof(X) - 1, X, sizeof(X) - 1, NULL, NULL }
+
+// one bit per port (bit 0 is 'Serial', bit 1 is 'Serial2', etc.), set by the RXC ISR when a
+// byte arrives, so that 'serialEventRun()' only has to look at ONE byte.  A GPIOR register is
+// in the lower I/O space, so 'sbi' sets a bit atomically in 1 cycle.  Can be overridden in
+// 'pins_arduino.h' if something else needs GPIOR0.  The bit number is the port index that
+// every per-port table uses ('_port', see 'serial_port_index()'), so member functions set
+// '_BV(_port)' and the ISRs the constant for their port.  There is no other mapping.
+#ifndef SERIAL_EVENT_FLAGS
+#define SERIAL_EVENT_FLAGS GPIO_GPIOR0
+#endif // SERIAL_EVENT_FLAGS
+
 // ring buffers for serial ports 1 and 2 (must zero head/tail before use)
 // NOTE:  there are ALWAYS at LEAST 2 serial ports:
 //        these are USARTD0 and USARTC0 (on pins 2,3) by default.
 
-ring_buffer rx_buffer; //  =  { { 0 }, 0, 0 };  // SERIAL_0
-ring_buffer tx_buffer; //  =  { { 0 }, 0, 0 };
-ring_buffer rx_buffer2; //  =  { { 0 }, 0, 0 }; // SERIAL_1
-ring_buffer tx_buffer2; //  =  { { 0 }, 0, 0 };
+static unsigned char rx_buffer_data[SERIAL_0_RX_BUFFER_SIZE];
+static unsigned char tx_buffer_data[SERIAL_0_TX_BUFFER_SIZE];
+ring_buffer rx_buffer = RING_BUFFER_INIT(rx_buffer_data);
+ring_buffer tx_buffer = RING_BUFFER_INIT(tx_buffer_data);
+SERIAL_STATS rx_stats; // error counters, RX only
+
+static unsigned char rx_buffer2_data[SERIAL_1_RX_BUFFER_SIZE];
+static unsigned char tx_buffer2_data[SERIAL_1_TX_BUFFER_SIZE];
+ring_buffer rx_buffer2 = RING_BUFFER_INIT(rx_buffer2_data);
+ring_buffer tx_buffer2 = RING_BUFFER_INIT(tx_buffer2_data);
+SERIAL_STATS rx_stats2; // error counters, RX only
 
 #ifdef SERIAL_2_PORT_NAME
-ring_buffer rx_buffer3; //  =  { { 0 }, 0, 0 };
-ring_buffer tx_buffer3; //  =  { { 0 }, 0, 0 };
+static unsigned char rx_buffer3_data[SERIAL_2_RX_BUFFER_SIZE];
+static unsigned char tx_buffer3_data[SERIAL_2_TX_BUFFER_SIZE];
+ring_buffer rx_buffer3 = RING_BUFFER_INIT(rx_buffer3_data);
+ring_buffer tx_buffer3 = RING_BUFFER_INIT(tx_buffer3_data);
+SERIAL_STATS rx_stats3; // error counters, RX only
 #endif // SERIAL_2_PORT_NAME
 
 #ifdef SERIAL_3_PORT_NAME
-ring_buffer rx_buffer4; //  =  { { 0 }, 0, 0 };
-ring_buffer tx_buffer4; //  =  { { 0 }, 0, 0 };
+static unsigned char rx_buffer4_data[SERIAL_3_RX_BUFFER_SIZE];
+static unsigned char tx_buffer4_data[SERIAL_3_TX_BUFFER_SIZE];
+ring_buffer rx_buffer4 = RING_BUFFER_INIT(rx_buffer4_data);
+ring_buffer tx_buffer4 = RING_BUFFER_INIT(tx_buffer4_data);
+SERIAL_STATS rx_stats4; // error counters, RX only
 #endif // SERIAL_3_PORT_NAME
 
 #ifdef SERIAL_4_PORT_NAME
-ring_buffer rx_buffer5; //  =  { { 0 }, 0, 0 };
-ring_buffer tx_buffer5; //  =  { { 0 }, 0, 0 };
+static unsigned char rx_buffer5_data[SERIAL_4_RX_BUFFER_SIZE];
+static unsigned char tx_buffer5_data[SERIAL_4_TX_BUFFER_SIZE];
+ring_buffer rx_buffer5 = RING_BUFFER_INIT(rx_buffer5_data);
+ring_buffer tx_buffer5 = RING_BUFFER_INIT(tx_buffer5_data);
+SERIAL_STATS rx_stats5; // error counters, RX only
 #endif // SERIAL_4_PORT_NAME
 
 #ifdef SERIAL_5_PORT_NAME
-ring_buffer rx_buffer6; //  =  { { 0 }, 0, 0 };
-ring_buffer tx_buffer6; //  =  { { 0 }, 0, 0 };
+static unsigned char rx_buffer6_data[SERIAL_5_RX_BUFFER_SIZE];
+static unsigned char tx_buffer6_data[SERIAL_5_TX_BUFFER_SIZE];
+ring_buffer rx_buffer6 = RING_BUFFER_INIT(rx_buffer6_data);
+ring_buffer tx_buffer6 = RING_BUFFER_INIT(tx_buffer6_data);
+SERIAL_STATS rx_stats6; // error counters, RX only
 #endif // SERIAL_5_PORT_NAME
 
 #ifdef SERIAL_6_PORT_NAME
-ring_buffer rx_buffer7; //  =  { { 0 }, 0, 0 };
-ring_buffer tx_buffer7; //  =  { { 0 }, 0, 0 };
+static unsigned char rx_buffer7_data[SERIAL_6_RX_BUFFER_SIZE];
+static unsigned char tx_buffer7_data[SERIAL_6_TX_BUFFER_SIZE];
+ring_buffer rx_buffer7 = RING_BUFFER_INIT(rx_buffer7_data);
+ring_buffer tx_buffer7 = RING_BUFFER_INIT(tx_buffer7_data);
+SERIAL_STATS rx_stats7; // error counters, RX only
 #endif // SERIAL_6_PORT_NAME
 
 #ifdef SERIAL_7_PORT_NAME
-ring_buffer rx_buffer8; //  =  { { 0 }, 0, 0 };
-ring_buffer tx_buffer8; //  =  { { 0 }, 0, 0 };
+static unsigned char rx_buffer8_data[SERIAL_7_RX_BUFFER_SIZE];
+static unsigned char tx_buffer8_data[SERIAL_7_TX_BUFFER_SIZE];
+ring_buffer rx_buffer8 = RING_BUFFER_INIT(rx_buffer8_data);
+ring_buffer tx_buffer8 = RING_BUFFER_INIT(tx_buffer8_data);
+SERIAL_STATS rx_stats8; // error counters, RX only
+#endif // SERIAL_7_PORT_NAME
+
+
+#if defined(SERIAL_7_PORT_NAME)
+#define SERIAL_NUM_PORTS 8
+#elif defined(SERIAL_6_PORT_NAME)
+#define SERIAL_NUM_PORTS 7
+#elif defined(SERIAL_5_PORT_NAME)
+#define SERIAL_NUM_PORTS 6
+#elif defined(SERIAL_4_PORT_NAME)
+#define SERIAL_NUM_PORTS 5
+#elif defined(SERIAL_3_PORT_NAME)
+#define SERIAL_NUM_PORTS 4
+#elif defined(SERIAL_2_PORT_NAME)
+#define SERIAL_NUM_PORTS 3
+#else
+#define SERIAL_NUM_PORTS 2
+#endif // SERIAL_n_PORT_NAME
+
+// RX hooks - see 'HardwareSerial::setRxHook()'.  The RXC ISR gives every byte to the hook
+// first, and only stores it in the RX buffer if the hook returns 'false'
+typedef struct _SERIAL_RX_HOOK_
+{
+  serialRxHook pHook;
+  void *pCtx;
+} SERIAL_RX_HOOK;
+
+static SERIAL_RX_HOOK serial_rx_hook[SERIAL_NUM_PORTS];
+
+// half duplex ports - see 'HardwareSerial::setHalfDuplex()'.  The TXC ISR turns the line around
+static HardwareSerial *serial_half_duplex[SERIAL_NUM_PORTS];
+
+// bridge between 2 ports - see 'HardwareSerial::bridge()'.  Only one at a time
+typedef struct _SERIAL_BRIDGE_
+{
+  HardwareSerial *pA, *pB;
+  unsigned long ulCount;    // bytes left (both directions) before it ends, 0 for no limit
+  uint16_t wIdleMs;         // idle timer 'ticks' that end it, 0 for no timeout
+  uint16_t wIdleCount;      // ticks since the last byte
+  volatile uint8_t bActive;
+} SERIAL_BRIDGE;
+
+static SERIAL_BRIDGE serial_bridge;
+
+// flow control - see 'HardwareSerial::setFlowControl()'.  RTS goes HIGH (stop sending to me) when
+// the RX buffer holds 'wHigh' bytes, and LOW again once reading gets it down to 'wLow'.  The DRE
+// ISR stops sending while CTS is HIGH, and the idle timer turns DRE back on when it goes LOW
+typedef struct _SERIAL_FLOW_
+{
+  PORT_t *pRTS, *pCTS;        // NULL when not used
+  uint8_t bRTS, bCTS;         // pin masks
+  serial_index_t wHigh, wLow; // RX buffer watermarks, in bytes
+  volatile USART_t *pUSART;   // for the idle timer
+  ring_buffer *pTX;
+  volatile uint8_t bWait;     // 1 while DRE is off because of CTS
+} SERIAL_FLOW;
+
+static SERIAL_FLOW serial_flow[SERIAL_NUM_PORTS];
+
+// ports that have a 'SERIAL_n_TXC_ISR', which half duplex needs
+static const uint8_t serial_txc_ports = 0
+#ifdef SERIAL_0_TXC_ISR
+  | _BV(0)
+#endif // SERIAL_0_TXC_ISR
+#ifdef SERIAL_1_TXC_ISR
+  | _BV(1)
+#endif // SERIAL_1_TXC_ISR
+#if defined(SERIAL_2_PORT_NAME) && defined(SERIAL_2_TXC_ISR)
+  | _BV(2)
+#endif // SERIAL_2_TXC_ISR
+#if defined(SERIAL_3_PORT_NAME) && defined(SERIAL_3_TXC_ISR)
+  | _BV(3)
+#endif // SERIAL_3_TXC_ISR
+#if defined(SERIAL_4_PORT_NAME) && defined(SERIAL_4_TXC_ISR)
+  | _BV(4)
+#endif // SERIAL_4_TXC_ISR
+#if defined(SERIAL_5_PORT_NAME) && defined(SERIAL_5_TXC_ISR)
+  | _BV(5)
+#endif // SERIAL_5_TXC_ISR
+#if defined(SERIAL_6_PORT_NAME) && defined(SERIAL_6_TXC_ISR)
+  | _BV(6)
+#endif // SERIAL_6_TXC_ISR
+#if defined(SERIAL_7_PORT_NAME) && defined(SERIAL_7_TXC_ISR)
+  | _BV(7)
+#endif // SERIAL_7_TXC_ISR
+  ;
+
+// DRE and RXC interrupt on/off.  CTRLA also holds the other levels (A manual sect 19.14.3), and
+// with DMA RX the RXC level is zero, so only the bits for the one interrupt change
+static inline void usart_dre_int(volatile USART_t *pUSART, bool bOn)
+{
+  if(bOn)
+  {
+    pUSART->CTRLA |= _BV(USART_DREINTLVL1_bp) | _BV(USART_DREINTLVL0_bp);
+  }
+  else
+  {
+    pUSART->CTRLA &= ~(_BV(USART_DREINTLVL1_bp) | _BV(USART_DREINTLVL0_bp));
+  }
+}
+
+static inline void usart_rxc_int(volatile USART_t *pUSART, bool bOn)
+{
+  if(bOn)
+  {
+    pUSART->CTRLA |= _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp);
+  }
+  else
+  {
+    pUSART->CTRLA &= ~(_BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp));
+  }
+}
+
+// port number (0 is 'Serial', 1 is 'Serial2', etc.) from its RX buffer, 0xff if unknown
+static uint8_t serial_port_index(ring_buffer *pR)
+{
+  if(pR == &rx_buffer)
+  {
+    return 0;
+  }
+  else if(pR == &rx_buffer2)
+  {
+    return 1;
+  }
+#ifdef SERIAL_2_PORT_NAME
+  else if(pR == &rx_buffer3)
+  {
+    return 2;
+  }
+#endif // SERIAL_2_PORT_NAME
+#ifdef SERIAL_3_PORT_NAME
+  else if(pR == &rx_buffer4)
+  {
+    return 3;
+  }
+#endif // SERIAL_3_PORT_NAME
+#ifdef SERIAL_4_PORT_NAME
+  else if(pR == &rx_buffer5)
+  {
+    return 4;
+  }
+#endif // SERIAL_4_PORT_NAME
+#ifdef SERIAL_5_PORT_NAME
+  else if(pR == &rx_buffer6)
+  {
+    return 5;
+  }
+#endif // SERIAL_5_PORT_NAME
+#ifdef SERIAL_6_PORT_NAME
+  else if(pR == &rx_buffer7)
+  {
+    return 6;
+  }
+#endif // SERIAL_6_PORT_NAME
+#ifdef SERIAL_7_PORT_NAME
+  else if(pR == &rx_buffer8)
+  {
+    return 7;
+  }
 #endif // SERIAL_7_PORT_NAME
 
+  return 0xff;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 //                                                                          //
@@ -188,7 +536,7 @@ ring_buffer tx_buffer8; //  =  { { 0 }, 0, 0 };
 //#endif // SERIAL_1_CTS_ENABLED
 
 
-// TODO:  _SOFT_ flow control enable/disable, arbitrary pin assignments for CTS/DTR
+// TODO:  _SOFT_ flow control enable/disable.  Any port can use any pins with 'setFlowControl()'
 
 #if defined(SERIAL_0_CTS_ENABLED)
 void InitSerialFlowControlInterrupt0(void)
@@ -286,14 +634,14 @@ char bCTS = SERIAL_0_CTS_PORT->IN & SERIAL_0_CTS_PIN;
   }
 #endif // SERIAL_0_CTS_ENABLED
 
+  serial_flow[0].bWait = 0;
+
   if(tx_buffer.head != tx_buffer.tail) // only when there's something to send
   {
     // re-enable the DRE interrupt - this will cause transmission to
     // occur again without code duplication.  see HardwareSerial::write()
 
-    (&(SERIAL_0_USART_NAME))->CTRLA /*USARTD0_CTRLA*/
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp)
-      | _BV(USART_DREINTLVL1_bp) | _BV(USART_DREINTLVL0_bp); // set int bits for rx and dre (sect 19.14.3)
+    usart_dre_int(&(SERIAL_0_USART_NAME), 1); // set int bits for dre, rx stays as it is
   }
 
   SREG=oldSREG; // interrupts re-enabled
@@ -318,13 +666,14 @@ char bCTS = SERIAL_1_CTS_PORT->IN & SERIAL_1_CTS_PIN;
   }
 #endif // SERIAL_1_CTS_ENABLED
 
+  serial_flow[1].bWait = 0;
+
   if (tx_buffer2.head != tx_buffer2.tail) // only when there's something to send
   {
     // re-enable the DRE interrupt - this will cause transmission to
     // occur again without code duplication.  see HardwareSerial::write()
 
-    USARTC0_CTRLA = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp)
-                  | _BV(USART_DREINTLVL1_bp) | _BV(USART_DREINTLVL0_bp); // set int bits for rx and dre (sect 19.14.3)
+    usart_dre_int(&USARTC0, 1);
   }
 
   SREG=oldSREG; // interrupts re-enabled
@@ -343,9 +692,63 @@ char bCTS = SERIAL_1_CTS_PORT->IN & SERIAL_1_CTS_PIN;
 //                                                                                      //
 //////////////////////////////////////////////////////////////////////////////////////////
 
-inline void store_char(unsigned char c, ring_buffer *buffer)
+// called by 'store_char()' BEFORE the byte goes in, so 'head' is where it will be
+static void serial_frame_mark(ring_buffer *buffer)
+{
+SERIAL_FRAME *pF = buffer->frame;
+unsigned long ulNow = micros();
+uint8_t i1;
+
+  // nothing queued means the last frame was read, so it was complete
+  if(ulNow - pF->ulLast > pF->ulGap || pF->bHead == pF->bTail)
+  {
+    i1 = (pF->bHead + 1) & (SERIAL_FRAME_MAX - 1);
+
+    if(i1 != pF->bTail) // when the queue is full, the new frame is added to the last one
+    {
+      pF->pos[pF->bHead] = buffer->head;
+      pF->time[pF->bHead] = ulNow;
+      pF->bHead = i1;
+    }
+  }
+
+  pF->ulLast = ulNow;
+}
+
+// receive error counters, from the STATUS that goes with the byte
+static inline void serial_count_errors(uint8_t stat, SERIAL_STATS *stats)
+{
+  // errors are rare, so only one test for the normal case (sect 19.14.2)
+  if(stat & (_BV(USART_BUFOVF_bp) | _BV(USART_FERR_bp) | _BV(USART_PERR_bp)))
+  {
+    if(stat & _BV(USART_BUFOVF_bp)) // a byte was lost BEFORE this one
+    {
+      stats->overrun++;
+    }
+
+    if(stat & _BV(USART_FERR_bp))
+    {
+      stats->framing++;
+    }
+
+    if(stat & _BV(USART_PERR_bp))
+    {
+      stats->parity++;
+    }
+  }
+}
+
+inline void store_char(unsigned char c, uint8_t stat, ring_buffer *buffer, SERIAL_STATS *stats)
 {
-  unsigned int i = (unsigned int)(buffer->head + 1) % SERIAL_BUFFER_SIZE;
+  serial_index_t i = (buffer->head + 1) & buffer->mask;
+  serial_index_t used;
+
+  if(buffer->frame) // gap framing is on
+  {
+    serial_frame_mark(buffer);
+  }
+
+  serial_count_errors(stat, stats);
 
   // if we should be storing the received character into the location
   // just before the tail (meaning that the head would advance to the
@@ -354,21 +757,70 @@ inline void store_char(unsigned char c, ring_buffer *buffer)
   if (i != buffer->tail)
   {
     buffer->buffer[buffer->head] = c;
+
+    if(buffer->bit9) // RXB8 is bit 0 of STATUS (sect 19.14.2)
+    {
+      if(stat & USART_RXB8_bm)
+      {
+        buffer->bit9[buffer->head >> 3] |= _BV(buffer->head & 7);
+      }
+      else
+      {
+        buffer->bit9[buffer->head >> 3] &= ~_BV(buffer->head & 7);
+      }
+    }
+
     buffer->head = i;
+
+    used = (i - buffer->tail) & buffer->mask;
+
+    if(used > stats->peak)
+    {
+      stats->peak = used;
+    }
+  }
+  else
+  {
+    stats->dropped++;
   }
 }
 
-inline char set_not_rts(ring_buffer *buffer)
+// bytes in the RX buffer - one subtraction, the mask takes care of the wrap
+static inline serial_index_t serial_rx_used(ring_buffer *buffer)
 {
-  unsigned int i1 = (unsigned int)(buffer->head + 3) % SERIAL_BUFFER_SIZE;
-  unsigned int i2 = (unsigned int)(buffer->head + 2) % SERIAL_BUFFER_SIZE;
-  unsigned int i3 = (unsigned int)(buffer->head + 1) % SERIAL_BUFFER_SIZE;
+  return (serial_index_t)(buffer->head - buffer->tail) & buffer->mask;
+}
 
-  // if we should be storing the received character into the location
-  // just before the tail (meaning that the head would advance to the
-  // current location of the tail), we're about to overflow the buffer
-  // and so we don't write the character or advance the head.
-  return i1 == buffer->tail || i2 == buffer->tail || i3 == buffer->tail;
+// RXC ISR, after storing a byte - RTS HIGH ('stop') at the high watermark
+static inline void serial_rts_rx(SERIAL_FLOW *pF, ring_buffer *buffer)
+{
+  if(pF->pRTS && serial_rx_used(buffer) >= pF->wHigh)
+  {
+    pF->pRTS->OUTSET = pF->bRTS;
+  }
+}
+
+// after reading - RTS LOW ('ok to send') at the low watermark.  Call with interrupts disabled
+static inline void serial_rts_read(SERIAL_FLOW *pF, ring_buffer *buffer)
+{
+  if(pF->pRTS && serial_rx_used(buffer) <= pF->wLow)
+  {
+    pF->pRTS->OUTCLR = pF->bRTS;
+  }
+}
+
+// DRE ISR - 'true' if CTS is HIGH and sending has to stop.  The DRE interrupt is turned off,
+// and 'serial_flow_tick()' turns it on again once CTS is LOW
+static inline bool serial_cts_hold(SERIAL_FLOW *pF)
+{
+  if(pF->pCTS && (pF->pCTS->IN & pF->bCTS))
+  {
+    pF->bWait = 1;
+
+    return true;
+  }
+
+  return false;
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -385,20 +837,19 @@ inline char set_not_rts(ring_buffer *buffer)
 
 SERIAL_0_RXC_ISR // ISR(USARTD0_RXC_vect)
 {
-unsigned char c;
+unsigned char c, stat;
 
-#ifdef SERIAL_0_RTS_ENABLED
-  if(set_not_rts(&rx_buffer)) // do I need to turn off RTS ?
-  {
-    SERIAL_0_RTS_PORT->OUT |= SERIAL_0_RTS_PIN; // set to '1'
-    SERIAL_0_RTS_PORT->DIR |= SERIAL_0_RTS_PIN; // make sure it's an output
-  }
-#endif // SERIAL_0_RTS_ENABLED
+  stat = (&(SERIAL_0_USART_NAME))->STATUS; /*USARTD0_STATUS*/ // error flags are for the byte in DATA, so read them first
 
-  if((&(SERIAL_0_USART_NAME))->STATUS /*USARTD0_STATUS*/ & _BV(USART_RXCIF_bp)) // if there is data available
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_0_USART_DATA; //USARTD0_DATA;
-    store_char(c, &rx_buffer);
+    if(!serial_rx_hook[0].pHook || !serial_rx_hook[0].pHook(serial_rx_hook[0].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer, &rx_stats);
+      serial_rts_rx(&serial_flow[0], &rx_buffer);
+      SERIAL_EVENT_FLAGS |= _BV(0); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -408,20 +859,19 @@ unsigned char c;
 
 SERIAL_1_RXC_ISR // ISR(USARTC0_RXC_vect)
 {
-unsigned char c;
+unsigned char c, stat;
 
-#ifdef SERIAL_1_RTS_ENABLED
-  if(set_not_rts(&rx_buffer2)) // do I need to turn off RTS ?
-  {
-    SERIAL_1_RTS_PORT->OUT |= SERIAL_1_RTS_PIN; // set to '1'
-    SERIAL_1_RTS_PORT->DIR |= SERIAL_1_RTS_PIN; // make sure it's an output
-  }
-#endif // SERIAL_0_RTS_ENABLED
+  stat = (&(SERIAL_1_USART_NAME))->STATUS; /*USARTC0_STATUS*/ // error flags are for the byte in DATA, so read them first
 
-  if((&(SERIAL_1_USART_NAME))->STATUS /*USARTC0_STATUS*/ & _BV(USART_RXCIF_bp)) // if there is data available
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_1_USART_DATA; //USARTC0_DATA;
-    store_char(c, &rx_buffer2);
+    if(!serial_rx_hook[1].pHook || !serial_rx_hook[1].pHook(serial_rx_hook[1].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer2, &rx_stats2);
+      serial_rts_rx(&serial_flow[1], &rx_buffer2);
+      SERIAL_EVENT_FLAGS |= _BV(1); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -432,12 +882,19 @@ unsigned char c;
 #ifdef SERIAL_2_PORT_NAME
 SERIAL_2_RXC_ISR // ISR(USARTE0_RXC_vect)
 {
-unsigned char c;
+unsigned char c, stat;
 
-  if((&(SERIAL_2_USART_NAME))->STATUS /*USARTE0_STATUS*/ & _BV(USART_RXCIF_bp)) // if there is data available
+  stat = (&(SERIAL_2_USART_NAME))->STATUS; /*USARTE0_STATUS*/ // error flags are for the byte in DATA, so read them first
+
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_2_USART_DATA; //USARTE0_DATA;
-    store_char(c, &rx_buffer3);
+    if(!serial_rx_hook[2].pHook || !serial_rx_hook[2].pHook(serial_rx_hook[2].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer3, &rx_stats3);
+      serial_rts_rx(&serial_flow[2], &rx_buffer3);
+      SERIAL_EVENT_FLAGS |= _BV(2); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -449,12 +906,19 @@ unsigned char c;
 #ifdef SERIAL_3_PORT_NAME
 SERIAL_3_RXC_ISR // ISR(USARTF0_RXC_vect)
 {
-unsigned char c;
+unsigned char c, stat;
+
+  stat = (&(SERIAL_3_USART_NAME))->STATUS; /*USARTF0_STATUS*/ // error flags are for the byte in DATA, so read them first
 
-  if((&(SERIAL_3_USART_NAME))->STATUS /*USARTF0_STATUS*/ & _BV(USART_RXCIF_bp)) // if there is data available
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_3_USART_DATA; //USARTF0_DATA;
-    store_char(c, &rx_buffer4);
+    if(!serial_rx_hook[3].pHook || !serial_rx_hook[3].pHook(serial_rx_hook[3].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer4, &rx_stats4);
+      serial_rts_rx(&serial_flow[3], &rx_buffer4);
+      SERIAL_EVENT_FLAGS |= _BV(3); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -466,12 +930,19 @@ unsigned char c;
 #ifdef SERIAL_4_PORT_NAME
 SERIAL_4_RXC_ISR
 {
-unsigned char c;
+unsigned char c, stat;
 
-  if((&(SERIAL_4_USART_NAME))->STATUS & _BV(USART_RXCIF_bp)) // if there is data available
+  stat = (&(SERIAL_4_USART_NAME))->STATUS; // error flags are for the byte in DATA, so read them first
+
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_4_USART_DATA;
-    store_char(c, &rx_buffer4);
+    if(!serial_rx_hook[4].pHook || !serial_rx_hook[4].pHook(serial_rx_hook[4].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer5, &rx_stats5);
+      serial_rts_rx(&serial_flow[4], &rx_buffer5);
+      SERIAL_EVENT_FLAGS |= _BV(4); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -483,12 +954,19 @@ unsigned char c;
 #ifdef SERIAL_5_PORT_NAME
 SERIAL_5_RXC_ISR
 {
-unsigned char c;
+unsigned char c, stat;
+
+  stat = (&(SERIAL_5_USART_NAME))->STATUS; // error flags are for the byte in DATA, so read them first
 
-  if((&(SERIAL_5_USART_NAME))->STATUS & _BV(USART_RXCIF_bp)) // if there is data available
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_5_USART_DATA;
-    store_char(c, &rx_buffer4);
+    if(!serial_rx_hook[5].pHook || !serial_rx_hook[5].pHook(serial_rx_hook[5].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer6, &rx_stats6);
+      serial_rts_rx(&serial_flow[5], &rx_buffer6);
+      SERIAL_EVENT_FLAGS |= _BV(5); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -500,12 +978,19 @@ unsigned char c;
 #ifdef SERIAL_6_PORT_NAME
 SERIAL_6_RXC_ISR
 {
-unsigned char c;
+unsigned char c, stat;
 
-  if((&(SERIAL_6_USART_NAME))->STATUS & _BV(USART_RXCIF_bp)) // if there is data available
+  stat = (&(SERIAL_6_USART_NAME))->STATUS; // error flags are for the byte in DATA, so read them first
+
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_6_USART_DATA;
-    store_char(c, &rx_buffer4);
+    if(!serial_rx_hook[6].pHook || !serial_rx_hook[6].pHook(serial_rx_hook[6].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer7, &rx_stats7);
+      serial_rts_rx(&serial_flow[6], &rx_buffer7);
+      SERIAL_EVENT_FLAGS |= _BV(6); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -517,12 +1002,19 @@ unsigned char c;
 #ifdef SERIAL_7_PORT_NAME
 SERIAL_7_RXC_ISR
 {
-unsigned char c;
+unsigned char c, stat;
+
+  stat = (&(SERIAL_7_USART_NAME))->STATUS; // error flags are for the byte in DATA, so read them first
 
-  if((&(SERIAL_7_USART_NAME))->STATUS & _BV(USART_RXCIF_bp)) // if there is data available
+  if(stat & _BV(USART_RXCIF_bp)) // if there is data available
   {
     c = SERIAL_7_USART_DATA;
-    store_char(c, &rx_buffer4);
+    if(!serial_rx_hook[7].pHook || !serial_rx_hook[7].pHook(serial_rx_hook[7].pCtx, c, stat))
+    {
+      store_char(c, stat, &rx_buffer8, &rx_stats8);
+      serial_rts_rx(&serial_flow[7], &rx_buffer8);
+      SERIAL_EVENT_FLAGS |= _BV(7); // for 'serialEventRun()' - this is a single 'sbi'
+    }
   }
   else // I got an interrupt for some reason, just eat data from data reg
   {
@@ -532,22 +1024,103 @@ unsigned char c;
 #endif // SERIAL_7_PORT_NAME
 
 
+// TXC - only enabled in half duplex mode.  It fires at the end of the stop bit of the last
+// byte, when the shift register AND the data register are empty (A manual sect 19.4.3)
+
+#ifdef SERIAL_0_TXC_ISR
+SERIAL_0_TXC_ISR
+{
+  if(serial_half_duplex[0])
+  {
+    serial_half_duplex[0]->hd_tx_done();
+  }
+}
+#endif // SERIAL_0_TXC_ISR
+
+#ifdef SERIAL_1_TXC_ISR
+SERIAL_1_TXC_ISR
+{
+  if(serial_half_duplex[1])
+  {
+    serial_half_duplex[1]->hd_tx_done();
+  }
+}
+#endif // SERIAL_1_TXC_ISR
+
+#if defined(SERIAL_2_PORT_NAME) && defined(SERIAL_2_TXC_ISR)
+SERIAL_2_TXC_ISR
+{
+  if(serial_half_duplex[2])
+  {
+    serial_half_duplex[2]->hd_tx_done();
+  }
+}
+#endif // SERIAL_2_TXC_ISR
+
+#if defined(SERIAL_3_PORT_NAME) && defined(SERIAL_3_TXC_ISR)
+SERIAL_3_TXC_ISR
+{
+  if(serial_half_duplex[3])
+  {
+    serial_half_duplex[3]->hd_tx_done();
+  }
+}
+#endif // SERIAL_3_TXC_ISR
+
+#if defined(SERIAL_4_PORT_NAME) && defined(SERIAL_4_TXC_ISR)
+SERIAL_4_TXC_ISR
+{
+  if(serial_half_duplex[4])
+  {
+    serial_half_duplex[4]->hd_tx_done();
+  }
+}
+#endif // SERIAL_4_TXC_ISR
+
+#if defined(SERIAL_5_PORT_NAME) && defined(SERIAL_5_TXC_ISR)
+SERIAL_5_TXC_ISR
+{
+  if(serial_half_duplex[5])
+  {
+    serial_half_duplex[5]->hd_tx_done();
+  }
+}
+#endif // SERIAL_5_TXC_ISR
+
+#if defined(SERIAL_6_PORT_NAME) && defined(SERIAL_6_TXC_ISR)
+SERIAL_6_TXC_ISR
+{
+  if(serial_half_duplex[6])
+  {
+    serial_half_duplex[6]->hd_tx_done();
+  }
+}
+#endif // SERIAL_6_TXC_ISR
+
+#if defined(SERIAL_7_PORT_NAME) && defined(SERIAL_7_TXC_ISR)
+SERIAL_7_TXC_ISR
+{
+  if(serial_half_duplex[7])
+  {
+    serial_half_duplex[7]->hd_tx_done();
+  }
+}
+#endif // SERIAL_7_TXC_ISR
+
+
 SERIAL_0_DRE_ISR // ISR(USARTD0_DRE_vect)
 {
 #ifdef SERIAL_0_CTS_ENABLED
 uint8_t oldSREG;
-char bCTS = SERIAL_0_CTS_PORT->IN & SERIAL_0_CTS_PIN;
 #endif // SERIAL_0_CTS_ENABLED
 
 
-  if (
-#ifdef SERIAL_0_CTS_ENABLED
-      bCTS ||
-#endif // SERIAL_0_CTS_ENABLED
-      tx_buffer.head == tx_buffer.tail)
+  if (tx_buffer.head == tx_buffer.tail || serial_cts_hold(&serial_flow[0]))
   {
 #ifdef SERIAL_0_CTS_ENABLED
-    if(bCTS)
+    // the CTS pin from 'pins_arduino.h' also has a pin change interrupt, for a faster restart
+    if(serial_flow[0].bWait && serial_flow[0].pCTS == SERIAL_0_CTS_PORT
+       && serial_flow[0].bCTS == SERIAL_0_CTS_PIN)
     {
       oldSREG = SREG; // store the interrupt flag basically
 
@@ -563,16 +1136,15 @@ char bCTS = SERIAL_0_CTS_PORT->IN & SERIAL_0_CTS_PIN;
     }
 #endif // SERIAL_0_CTS_ENABLED
 
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_0_USART_NAME))->CTRLA /*USARTD0_CTRLA*/
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_0_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
     register unsigned char c = tx_buffer.buffer[tx_buffer.tail];
-    tx_buffer.tail = (tx_buffer.tail + 1) % SERIAL_BUFFER_SIZE;
+    tx_buffer.tail = (tx_buffer.tail + 1) & tx_buffer.mask;
 
     SERIAL_0_USART_DATA = c; //USARTD0_DATA = c;
   }
@@ -582,19 +1154,15 @@ SERIAL_1_DRE_ISR // ISR(USARTC0_DRE_vect)
 {
 #ifdef SERIAL_1_CTS_ENABLED
 uint8_t oldSREG;
-char bCTS = SERIAL_1_CTS_PORT->IN & SERIAL_1_CTS_PIN;
 #endif // SERIAL_1_CTS_ENABLED
 
 
-  if (
-#ifdef SERIAL_1_CTS_ENABLED
-      bCTS ||
-#endif // SERIAL_1_CTS_ENABLED
-      tx_buffer2.head == tx_buffer2.tail)
-
+  if (tx_buffer2.head == tx_buffer2.tail || serial_cts_hold(&serial_flow[1]))
   {
 #ifdef SERIAL_1_CTS_ENABLED
-    if(bCTS)
+    // the CTS pin from 'pins_arduino.h' also has a pin change interrupt, for a faster restart
+    if(serial_flow[1].bWait && serial_flow[1].pCTS == SERIAL_1_CTS_PORT
+       && serial_flow[1].bCTS == SERIAL_1_CTS_PIN)
     {
       oldSREG = SREG; // store the interrupt flag basically
 
@@ -610,16 +1178,15 @@ char bCTS = SERIAL_1_CTS_PORT->IN & SERIAL_1_CTS_PIN;
     }
 #endif // SERIAL_1_CTS_ENABLED
 
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_1_USART_NAME))->CTRLA /*USARTC0_CTRLA*/
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_1_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
     register unsigned char c = tx_buffer2.buffer[tx_buffer2.tail];
-    tx_buffer2.tail = (tx_buffer2.tail + 1) % SERIAL_BUFFER_SIZE;
+    tx_buffer2.tail = (tx_buffer2.tail + 1) & tx_buffer2.mask;
 
     SERIAL_1_USART_DATA = c; //USARTC0_DATA = c;
   }
@@ -628,18 +1195,17 @@ char bCTS = SERIAL_1_CTS_PORT->IN & SERIAL_1_CTS_PIN;
 #ifdef SERIAL_2_PORT_NAME
 SERIAL_2_DRE_ISR // ISR(USARTE0_DRE_vect)
 {
-  if (tx_buffer3.head == tx_buffer3.tail)
+  if (tx_buffer3.head == tx_buffer3.tail || serial_cts_hold(&serial_flow[2]))
   {
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_2_USART_NAME))->CTRLA /*USARTE0_CTRLA*/
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_2_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
     register unsigned char c = tx_buffer3.buffer[tx_buffer3.tail];
-    tx_buffer3.tail = (tx_buffer3.tail + 1) % SERIAL_BUFFER_SIZE;
+    tx_buffer3.tail = (tx_buffer3.tail + 1) & tx_buffer3.mask;
 
     SERIAL_2_USART_DATA = c; //USARTE0_DATA = c;
   }
@@ -649,18 +1215,17 @@ SERIAL_2_DRE_ISR // ISR(USARTE0_DRE_vect)
 #ifdef SERIAL_3_PORT_NAME
 SERIAL_3_DRE_ISR // ISR(USARTF0_DRE_vect)
 {
-  if (tx_buffer4.head == tx_buffer4.tail)
+  if (tx_buffer4.head == tx_buffer4.tail || serial_cts_hold(&serial_flow[3]))
   {
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_3_USART_NAME))->CTRLA /*USARTF0_CTRLA*/
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_3_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
     register unsigned char c = tx_buffer4.buffer[tx_buffer4.tail];
-    tx_buffer4.tail = (tx_buffer4.tail + 1) % SERIAL_BUFFER_SIZE;
+    tx_buffer4.tail = (tx_buffer4.tail + 1) & tx_buffer4.mask;
 
     SERIAL_3_USART_DATA = c; //USARTE0_DATA = c;
   }
@@ -670,18 +1235,17 @@ SERIAL_3_DRE_ISR // ISR(USARTF0_DRE_vect)
 #ifdef SERIAL_4_PORT_NAME
 SERIAL_4_DRE_ISR
 {
-  if (tx_buffer4.head == tx_buffer4.tail)
+  if (tx_buffer5.head == tx_buffer5.tail || serial_cts_hold(&serial_flow[4]))
   {
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_4_USART_NAME))->CTRLA
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_4_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
-    register unsigned char c = tx_buffer4.buffer[tx_buffer4.tail];
-    tx_buffer4.tail = (tx_buffer4.tail + 1) % SERIAL_BUFFER_SIZE;
+    register unsigned char c = tx_buffer5.buffer[tx_buffer5.tail];
+    tx_buffer5.tail = (tx_buffer5.tail + 1) & tx_buffer5.mask;
 
     SERIAL_4_USART_DATA = c;
   }
@@ -691,18 +1255,17 @@ SERIAL_4_DRE_ISR
 #ifdef SERIAL_5_PORT_NAME
 SERIAL_5_DRE_ISR
 {
-  if (tx_buffer4.head == tx_buffer4.tail)
+  if (tx_buffer6.head == tx_buffer6.tail || serial_cts_hold(&serial_flow[5]))
   {
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_5_USART_NAME))->CTRLA
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_5_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
-    register unsigned char c = tx_buffer4.buffer[tx_buffer4.tail];
-    tx_buffer4.tail = (tx_buffer4.tail + 1) % SERIAL_BUFFER_SIZE;
+    register unsigned char c = tx_buffer6.buffer[tx_buffer6.tail];
+    tx_buffer6.tail = (tx_buffer6.tail + 1) & tx_buffer6.mask;
 
     SERIAL_5_USART_DATA = c;
   }
@@ -712,18 +1275,17 @@ SERIAL_5_DRE_ISR
 #ifdef SERIAL_6_PORT_NAME
 SERIAL_6_DRE_ISR
 {
-  if (tx_buffer4.head == tx_buffer4.tail)
+  if (tx_buffer7.head == tx_buffer7.tail || serial_cts_hold(&serial_flow[6]))
   {
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_6_USART_NAME))->CTRLA
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_6_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
-    register unsigned char c = tx_buffer4.buffer[tx_buffer4.tail];
-    tx_buffer4.tail = (tx_buffer4.tail + 1) % SERIAL_BUFFER_SIZE;
+    register unsigned char c = tx_buffer7.buffer[tx_buffer7.tail];
+    tx_buffer7.tail = (tx_buffer7.tail + 1) & tx_buffer7.mask;
 
     SERIAL_6_USART_DATA = c;
   }
@@ -733,18 +1295,17 @@ SERIAL_6_DRE_ISR
 #ifdef SERIAL_7_PORT_NAME
 SERIAL_7_DRE_ISR
 {
-  if (tx_buffer4.head == tx_buffer4.tail)
+  if (tx_buffer8.head == tx_buffer8.tail || serial_cts_hold(&serial_flow[7]))
   {
-    // Buffer empty, so disable interrupts
+    // Buffer empty (or CTS is HIGH), so disable interrupts
     // section 19.14.3 - the CTRLA register (interrupt stuff)
-    (&(SERIAL_7_USART_NAME))->CTRLA
-      = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp); // only set these 2 (the DRE int is now OFF)
+    usart_dre_int(&(SERIAL_7_USART_NAME), 0); // the DRE int is now OFF, rx stays as it is
   }
   else
   {
     // There is more data in the output buffer. Send the next byte
-    register unsigned char c = tx_buffer4.buffer[tx_buffer4.tail];
-    tx_buffer4.tail = (tx_buffer4.tail + 1) % SERIAL_BUFFER_SIZE;
+    register unsigned char c = tx_buffer8.buffer[tx_buffer8.tail];
+    tx_buffer8.tail = (tx_buffer8.tail + 1) & tx_buffer8.mask;
 
     SERIAL_7_USART_DATA = c;
   }
@@ -876,770 +1437,2614 @@ void call_isr(volatile USART_t *pPort)
 
 //////////////////////////////////////////////////////////////////////////////
 //                                                                          //
-//    ____               _         _   _____                     _          //
-//   / ___|   ___  _ __ (_)  __ _ | | | ____|__   __ ___  _ __  | |_  ___   //
-//   \___ \  / _ \| '__|| | / _` || | |  _|  \ \ / // _ \| '_ \ | __|/ __|  //
-//    ___) ||  __/| |   | || (_| || | | |___  \ V /|  __/| | | || |_ \__ \  //
-//   |____/  \___||_|   |_| \__,_||_| |_____|  \_/  \___||_| |_| \__||___/  //
+//                   ____   __  __     _                                    //
+//                  |  _ \ |  \/  |   / \                                   //
+//                  | | | || |\/| |  / _ \                                  //
+//                  | |_| || |  | | / ___ \                                 //
+//                  |____/ |_|  |_|/_/   \_\                                //
 //                                                                          //
 //                                                                          //
 //////////////////////////////////////////////////////////////////////////////
 
-void serialEvent() __attribute__((weak));
-void serialEvent() {}
-#define serialEvent_implemented
+// With DMA TX, the DRE interrupt stays OFF.  Instead, a DMA channel triggered by DRE copies
+// the next contiguous block of the transmit ring buffer (from 'tail' up to 'head' or the end
+// of the buffer) straight into DATA, one byte per trigger.  The CPU only gets the 'block
+// complete' interrupt, which advances 'tail' and starts the next block.  See A manual sect 5.
 
-void serialEvent2() __attribute__((weak));
-void serialEvent2() {}
-#define serialEvent2_implemented
+// 'true' if the port has CTS flow control, which only the DRE ISR knows how to handle
+static bool serial_cts_enabled(uint8_t bPort)
+{
+  return bPort < SERIAL_NUM_PORTS && serial_flow[bPort].pCTS != NULL;
+}
 
-#ifdef SERIAL_2_PORT_NAME
-void serialEvent3() __attribute__((weak));
-void serialEvent3() {}
-#define serialEvent3_implemented
-#endif // SERIAL_2_PORT_NAME
+// DMA trigger source for a USART.  They are in groups of 0x20 per port (C, D, E, F) starting with
+// USARTC0, with RXC/DRE at +0 and +1 for USARTx0, +3 and +4 for USARTx1 (A manual sect 5.15.6)
+static uint8_t usart_dma_trigger(volatile USART_t *pUSART, uint8_t bDRE)
+{
+uint16_t wAddr = (uint16_t)pUSART;
 
-#ifdef SERIAL_3_PORT_NAME
-void serialEvent4() __attribute__((weak));
-void serialEvent4() {}
-#define serialEvent4_implemented
-#endif // SERIAL_3_PORT_NAME
+  return DMA_CH_TRIGSRC_USARTC0_RXC_gc
+         + (uint8_t)(((wAddr - (uint16_t)&USARTC0) >> 8) << 5) // 0x100 apart, 0x20 trigger sources apart
+         + ((wAddr & 0x10) ? 3 : 0)                            // USARTx1
+         + (bDRE ? 1 : 0);
+}
 
-#ifdef SERIAL_4_PORT_NAME
-void serialEvent5() __attribute__((weak));
-void serialEvent5() {}
-#define serialEvent5_implemented
-#endif // SERIAL_4_PORT_NAME
-
-#ifdef SERIAL_5_PORT_NAME
-void serialEvent6() __attribute__((weak));
-void serialEvent6() {}
-#define serialEvent6_implemented
-#endif // SERIAL_5_PORT_NAME
-
-#ifdef SERIAL_6_PORT_NAME
-void serialEvent7() __attribute__((weak));
-void serialEvent7() {}
-#define serialEvent7_implemented
-#endif // SERIAL_6_PORT_NAME
+static void serial_dma_tx_callback(void *pCtx, uint8_t bStatus)
+{
+  (void)bStatus; // DMA_STATUS_ERROR or not, the block is finished - the data is lost, the next block goes out
 
-#ifdef SERIAL_7_PORT_NAME
-void serialEvent8() __attribute__((weak));
-void serialEvent8() {}
-#define serialEvent8_implemented
-#endif // SERIAL_7_PORT_NAME
+  ((HardwareSerial *)pCtx)->dma_tx_done();
+}
 
-void serialEventRun(void)
+// start the next DMA block, if there is one.  Call with interrupts disabled
+void HardwareSerial::dma_tx_start(void)
 {
-// TODO: support this
+DMA_CH_t *pCH;
+unsigned int iHead, iTail, iLen;
+uint16_t wAddr;
 
-#ifdef serialEvent_implemented
-#ifdef USBCON
-  if (Serial1.available())
-#else // normal
-  if (Serial.available())
-#endif // USBCON, normal
+  if(_dma_tx_len) // already running
   {
-    serialEvent();
+    return;
   }
-#endif // serialEvent_implemented
 
-#ifdef serialEvent2_implemented
-  if (Serial2.available())
-  {
-    serialEvent2();
-  }
-#endif // serialEvent2_implemented
+  iHead = _tx_buffer->head;
+  iTail = _tx_buffer->tail;
 
-#ifdef serialEvent3_implemented
-  if (Serial3.available())
+  if(iHead == iTail)
   {
-    serialEvent3();
+    return; // nothing to send
   }
-#endif // serialEvent3_implemented
 
-#ifdef serialEvent4_implemented
-  if (Serial4.available())
-  {
-    serialEvent4();
-  }
-#endif // serialEvent4_implemented
+  iLen = iHead > iTail ? iHead - iTail : (unsigned int)_tx_buffer->mask + 1 - iTail; // up to the end of the buffer
 
-#ifdef serialEvent5_implemented
-  if (Serial5.available())
-  {
-    serialEvent5();
-  }
-#endif // serialEvent5_implemented
+  pCH = dmaChannel(_dma_tx);
 
-#ifdef serialEvent6_implemented
-  if (Serial6.available())
-  {
-    serialEvent6();
-  }
-#endif // serialEvent6_implemented
+  wAddr = (uint16_t)&(_tx_buffer->buffer[iTail]);
+  pCH->SRCADDR0 = (uint8_t)wAddr;
+  pCH->SRCADDR1 = (uint8_t)(wAddr >> 8);
+  pCH->TRFCNT = iLen;
 
-#ifdef serialEvent7_implemented
-  if (Serial7.available())
-  {
-    serialEvent7();
-  }
-#endif // serialEvent7_implemented
+  _dma_tx_len = iLen;
+
+  transmitting = true;
+  _usart->STATUS = _BV(USART_TXCIF_bp); // other bits must be written as zero
 
+  pCH->CTRLA |= DMA_CH_ENABLE_bm; // DRE is already set if DATA is empty, so it starts right away
 }
 
+void HardwareSerial::dma_tx_done(void)
+{
+  _tx_buffer->tail = (_tx_buffer->tail + _dma_tx_len) & _tx_buffer->mask;
+  _dma_tx_len = 0;
 
-///////////////////////////////////////////////////////////////////////////////////
-//                                                                               //
-//   ____                     _   ____         _           ____        _         //
-//  | __ )   __ _  _   _   __| | |  _ \  __ _ | |_  ___   / ___| __ _ | |  ___   //
-//  |  _ \  / _` || | | | / _` | | |_) |/ _` || __|/ _ \ | |    / _` || | / __|  //
-//  | |_) || (_| || |_| || (_| | |  _ <| (_| || |_|  __/ | |___| (_| || || (__   //
-//  |____/  \__,_| \__,_| \__,_| |_| \_\\__,_| \__|\___|  \____|\__,_||_| \___|  //
-//                                                                               //
-//                                                                               //
-///////////////////////////////////////////////////////////////////////////////////
+  dma_tx_start(); // anything that was added while this block was going out
+}
 
-// this function that uses 'canned' baud rate values is 'temporary'.  A proper one that
-// calculates the baud rate values will appear at some point in the future, once I have
-// a nice bullet-proof algorithm for it.
+// With DMA RX, the RXC interrupt is OFF.  A DMA channel triggered by RXC writes into the receive
+// ring buffer, wrapping around at the end forever, so 'head' is simply the DMA write position
+// (calculated from the remaining transfer count).  There are NO interrupts per byte at all.
+// If the buffer is not read in time, the oldest data is overwritten.
 //
-// See page 233 XMEGA-A-Manual.pdf
-
-uint16_t temp_get_baud(unsigned long baud, uint8_t use_u2x)
-{
-    uint16_t i1;
-
-    // standard baud rates
-    static const unsigned long aBaud[] PROGMEM =
-    {
-        1200, 2400, 4800, 9600, 14400, 19200, 28800, 38400, 57600,
-        /*76800,*/ 115200, 230400, 460800, 921600
-    };
-
-#if F_CPU == 32000000
-    // Note that this values assume F_CPU==32000000
-    // 2x constants for standard baud rates
-    static const uint16_t a2x[] PROGMEM =
-    {
-        0,                          // 1200
-        (7 << 12) | 12,             // 2400
-        (6 << 12) | 12,             // 4800
-        (5 << 12) | 12,             // 9600
-        (1 << 12) | 138,            // 14400
-        (4 << 12) | 12,             // 19200
-        138,                        // 28800
-        (3 << 12) | 12,             // 38400
-        (uint16_t)(-1 << 12) | 137, // 57600
-        //(2 << 12) | 12,             // 76800
-        (uint16_t)(-2 << 12) | 135, // 115200
-        (uint16_t)(-3 << 12) | 131, // 230400
-        (uint16_t)(-4 << 12) | 123, // 460800
-        (uint16_t)(-5 << 12) | 107  // 921600
-    };
-
-    // 1x constants for standard baud rates
-    static const uint16_t a1x[] PROGMEM =
-    {
-        0,                          // 1200
-        (6 << 12) | 12,             // 2400
-        (5 << 12) | 12,             // 4800
-        (4 << 12) | 12,             // 9600
-        138,                        // 14400
-        (3 << 12) | 12,             // 19200
-        (uint16_t)(-1 << 12) | 137, // 28800
-        (2 << 12) | 12,             // 38400
-        (uint16_t)(-2 << 12) | 135, // 57600
-        //(1 << 12) | 12,             // 76800
-        (uint16_t)(-3 << 12) | 131, // 115200
-        (uint16_t)(-4 << 12) | 123, // 230400
-        (uint16_t)(-5 << 12) | 107, // 460800
-        (uint16_t)(-6 << 12) | 75   // 921600
-    };
-#elif F_CPU == 16000000
-    // Note that this values assume F_CPU==16000000
-    // 2x constants for standard baud rates
-    static const uint16_t a2x[] PROGMEM =
-    {
-        (15U << 12) + 3331,  // 1200
-        (14U << 12) + 3329,  // 2400
-        (13U << 12) + 3325,  // 4800
-        (12U << 12) + 3317,  // 9600
-        (12U << 12) + 2206,  // 14400
-        (11U << 12) + 3301,  // 19200
-        (11U << 12) + 2190,  // 28800
-        (10U << 12) + 3269,  // 38400
-        (10U << 12) + 2158,  // 57600
-        (10U << 12) + 1047,  // 115200
-        (9U << 12) + 983,    // 230400
-        (9U << 12) + 428,    // 460800
-        (9U << 12) + 150     // 921600
-    };
-
-    // 1x constants for standard baud rates
-    static const uint16_t a1x[] PROGMEM =
-    {
-        (14U << 12) + 3329,  // 1200
-        (13U << 12) + 3325,  // 2400
-        (12U << 12) + 3317,  // 4800
-        (11U << 12) + 3301,  // 9600
-        (11U << 12) + 2190,  // 14400
-        (10U << 12) + 3269,  // 19200
-        (10U << 12) + 2158,  // 28800
-        (9U << 12) + 3205,   // 38400
-        (9U << 12) + 2094,   // 57600
-        (9U << 12) + 983,    // 115200
-        (9U << 12) + 428,    // 230400
-        (9U << 12) + 150,    // 460800
-        (9U << 12) + 11      // 921600
-    };
-#else
-#error Unsupported F_CPU for serial baud value generation
-#endif
+// The end of a frame is detected by an idle timer - the TCD0 CCD interrupt, which happens once
+// per system timer period (appx 1ms), checks whether the DMA write position has changed.
 
-    // TODO:  binary search is faster, but uses more code
-    for(i1 = 0; i1 < sizeof(aBaud) / sizeof(aBaud[0]); i1++)
+#define SERIAL_DMA_RX_MAX 4 /* number of ports that can use DMA RX at the same time */
+
+static HardwareSerial *serial_dma_rx_port[SERIAL_DMA_RX_MAX];
+
+static void serial_bridge_tick(void);
+
+// CTS - turn the DRE interrupt back on once CTS is LOW.  The DRE ISR checks it again
+static void serial_flow_tick(void)
+{
+uint8_t i1;
+SERIAL_FLOW *pF;
+
+  for(i1=0, pF=serial_flow; i1 < SERIAL_NUM_PORTS; i1++, pF++)
+  {
+    if(pF->bWait && !(pF->pCTS->IN & pF->bCTS))
     {
-        unsigned long dw1 = pgm_read_dword(&aBaud[i1]);
+      pF->bWait = 0;
 
-        if(baud == dw1)
-        {
-            if(use_u2x)
-                return pgm_read_word(&a2x[i1]);
-            else
-                return pgm_read_word(&a1x[i1]);
-        }
+      if(pF->pTX->head != pF->pTX->tail)
+      {
+        usart_dre_int(pF->pUSART, 1);
+      }
     }
-
-    // NOTE:  baud <= F_CPU / 16 for 1x, F_CPU / 8 for 2x
-    //
-    // X = clk_2x ? 8 : 16    bscale >= 0:  bsel = F_CPU / ( (2 ^ bscale) * X * baud) - 1
-    //                                      baud = F_CPU / ( (2 ^ bscale) * X * (bsel + 1) )
-    //                        bscale < 0:   bsel = (1 / (2 ^ (bscale))) * (F_CPU / (X * baud) - 1)
-    //                                      baud = F_CPU / ( X * (((2 ^ bscale) * bsel) + 1) )
-    //
-    // NOTE:  if bsel is zero for a given bscale, then use bscale=0 and bsel=2^(bscale - 1)
-    //        see section 19.3.1
-    //
-    // find 'best fit baud' by calculating the best 'bscale' and 'bsel' for a given baud
-    // bscale is -7 through +7 so this can be done in a simple loop
-
-    // for now [half the maximum baud rate]
-    return 1;
+  }
 }
 
 
+ISR(TCD0_CCD_vect)
+{
+uint8_t i1;
 
+  for(i1=0; i1 < SERIAL_DMA_RX_MAX; i1++)
+  {
+    if(serial_dma_rx_port[i1])
+    {
+      serial_dma_rx_port[i1]->dma_rx_tick();
+    }
+  }
 
-/////////////////////////////////////////////////////////////////////////////////////////////
-//                                                                                         //
-//   _   _                  _                             ____               _         _   //
-//  | | | |  __ _  _ __  __| |__      __ __ _  _ __  ___ / ___|   ___  _ __ (_)  __ _ | |  //
-//  | |_| | / _` || '__|/ _` |\ \ /\ / // _` || '__|/ _ \\___ \  / _ \| '__|| | / _` || |  //
-//  |  _  || (_| || |  | (_| | \ V  V /| (_| || |  |  __/ ___) ||  __/| |   | || (_| || |  //
-//  |_| |_| \__,_||_|   \__,_|  \_/\_/  \__,_||_|   \___||____/  \___||_|   |_| \__,_||_|  //
-//                                                                                         //
-//                                                                                         //
-/////////////////////////////////////////////////////////////////////////////////////////////
+  serial_bridge_tick();
+  serial_flow_tick();
+}
 
-// Constructors ////////////////////////////////////////////////////////////////
+// current DMA write position in the receive buffer.  Call with interrupts disabled
+unsigned int HardwareSerial::dma_rx_pos(void)
+{
+  // TRFCNT counts down from the buffer size, and is re-loaded when it reaches zero
+  return ((unsigned int)_rx_buffer->mask + 1 - dmaRemaining(_dma_rx)) & _rx_buffer->mask;
+}
 
-/*
-void HardwareSerial::init(
-    ring_buffer *rx_buffer0,
-    ring_buffer *tx_buffer0,
-    uint16_t usart0)
+void HardwareSerial::dma_rx_tick(void)
 {
-    register ring_buffer *pR = rx_buffer0;
-    register ring_buffer *pT = tx_buffer0;
+unsigned int iPos = dma_rx_pos();
 
-    _rx_buffer = pR; //rx_buffer0;
-    _tx_buffer = pT; //tx_buffer0;
-    _usart = (volatile USART_t *)usart0;
+  if(iPos != _rx_idle_pos)
+  {
+    SERIAL_EVENT_FLAGS |= _BV(_port); // no RXC ISR with DMA, so do it here
 
-    pR->head = 0;
-    pR->tail = 0;
-    pT->head = 0;
-    pT->tail = 0;
-    // memset(rx_buffer0, 0, sizeof(*rx_buffer0));
-    // memset(tx_buffer0, 0, sizeof(*tx_buffer0));
+    _rx_idle_pos = iPos;
+    _rx_idle_count = 0;
+    _rx_active = 1;
+  }
+  else if(_rx_active && ++_rx_idle_count >= _rx_idle_ms)
+  {
+    _rx_active = 0;
+    _rx_idle = 1;
+  }
 }
-*/
 
-HardwareSerial::HardwareSerial(
-    ring_buffer *rx_buffer0,
-    ring_buffer *tx_buffer0,
-    uint16_t usart0) /*__attribute__ ((noinline))*/
+bool HardwareSerial::rxIdle(void)
 {
-    register ring_buffer *pR = rx_buffer0;
-    register ring_buffer *pT = tx_buffer0;
+uint8_t oldSREG = SREG;
+bool bRval;
 
-    // init(rx_buffer0, tx_buffer0, usart0); this is larger code, left for reference
+  cli();
 
-    _rx_buffer = pR; //rx_buffer0;
-    _tx_buffer = pT; //tx_buffer0;
-    _usart = (volatile USART_t *)usart0;
+  bRval = _rx_idle;
+  _rx_idle = 0;
 
-    pR->head = 0;
-    pR->tail = 0;
-    pT->head = 0;
-    pT->tail = 0;
-    // memset(rx_buffer0, 0, sizeof(*rx_buffer0));
-    // memset(tx_buffer0, 0, sizeof(*tx_buffer0));
+  SREG = oldSREG;
+
+  return bRval;
 }
 
-// Public Methods //////////////////////////////////////////////////////////////
+// the idle timer only runs when somebody needs it (DMA RX, a bridge with an idle timeout, or CTS).
+// 'wiring.c' parks CCD at FFFFH, which never matches, so move it inside the period (PER is 255).
+// On the RX boards, no PWM pin uses TCD0, so CCD is free.
+//
+// NOTE:  the USART has no idle-line interrupt, and the ideal replacement (a timer restarted by
+//        every RX event, with a compare at 1-2 character times) needs a TC of its own.  On the
+//        ATxmega32A4 all 5 of them are taken (PWM, millis, and TCE0 for tone/softPWM etc.), so
+//        the millis timer provides a tick instead:  64 * 256 clocks, 1.024ms at 16Mhz.  That is
+//        about 1 character at 9600 baud, but 11 at 115200, so the idle timeout is only a 'frame
+//        gap' detector for protocols with gaps of a few ms (e.g. Modbus RTU at low baud rates,
+//        or request/response traffic).
+static void serial_tick_update(void)
+{
+uint8_t i1, bAny = 0;
 
-// 'D' manual, section 19.5
-// USART Initialization
-// USART initialization should use the following sequence:
-// 1. Set the TxD pin value high, and optionally set the XCK pin low.
-// 2. Set the TxD and optionally the XCK pin as output.
-// 3. Set the baud rate and frame format.
-// 4. Set the mode of operation (enables XCK pin output in synchronous mode).
-// 5. Enable the transmitter or the receiver, depending on the usage.
-// For interrupt-driven USART operation, global interrupts should be disabled during the initialization.
-// Before doing a re-initialization with a changed baud rate or frame format, be sure that there are no ongoing transmissions
-// while the registers are changed.
+  for(i1=0; i1 < SERIAL_DMA_RX_MAX; i1++)
+  {
+    if(serial_dma_rx_port[i1])
+    {
+      bAny = 1;
+    }
+  }
 
-void HardwareSerial::begin(
-    unsigned long baud)
+  if(serial_bridge.bActive && serial_bridge.wIdleMs)
+  {
+    bAny = 1;
+  }
+
+  for(i1=0; i1 < SERIAL_NUM_PORTS; i1++)
+  {
+    if(serial_flow[i1].pCTS)
+    {
+      bAny = 1;
+    }
+  }
+
+  if(bAny)
+  {
+    TCD0_CCD = 128;
+    TCD0_INTFLAGS = TC0_CCDIF_bm;
+    TCD0_INTCTRLB = (TCD0_INTCTRLB & ~TC0_CCDINTLVL_gm) | TC_CCDINTLVL_LO_gc;
+  }
+  else
+  {
+    TCD0_INTCTRLB &= ~TC0_CCDINTLVL_gm;
+  }
+}
+
+static void serial_dma_rx_register(HardwareSerial *pSerial, bool bAdd)
 {
-    begin(baud, SERIAL_8N1);
+uint8_t i1;
+
+  for(i1=0; i1 < SERIAL_DMA_RX_MAX; i1++)
+  {
+    if(serial_dma_rx_port[i1] == pSerial)
+    {
+      serial_dma_rx_port[i1] = NULL;
+    }
+
+    if(bAdd && !serial_dma_rx_port[i1])
+    {
+      serial_dma_rx_port[i1] = pSerial;
+      bAdd = false;
+    }
+  }
+
+  serial_tick_update();
 }
 
-void HardwareSerial::begin(
-    unsigned long baud,
-    byte config)
+bool HardwareSerial::enableDMA(uint8_t mode)
 {
-    uint16_t baud_setting;
-    uint8_t use_u2x;
-    uint8_t bit, bitTX=3, bitRX=2; // defaults
-    volatile uint8_t *reg;
-    volatile uint8_t *out;
-    volatile uint8_t *ctrlT;
-    volatile uint8_t *ctrlR;
-    uint8_t oldSREG;
+DMA_SETUP setup;
+uint8_t oldSREG;
 
+  // turn off what is on now - wait for the transmit buffer to empty first
 
-//    if (baud <= 57600)
-    if (baud <= 57600)
-        use_u2x = 0;
-    else
-        // enable CLK2X - bit 2 in the CTRLB
-        // register (section 19.14.4)
-        use_u2x = _BV(USART_CLK2X_bp);
+  if(_dma_tx >= 0)
+  {
+    if(SREG & CPU_I_bm)
+    {
+      while(_dma_tx_len) { }
+    }
 
-    // pre-assign
-    transmitting = false;
+    dmaFreeChannel(_dma_tx);
 
-    // baud rate calc - page 220 table 19-E5
-    //                  [for standard values]
-    //                  table 19-1 (page 211)
-    //                  for calculation formulae
-    // (also see theory discussion on page 219)
-    baud_setting = temp_get_baud(baud, use_u2x);
+    _dma_tx = -1;
+    _dma_tx_len = 0;
 
-    // save old to restore interrupts as they
-    // were
+    // if anything is left over, the DRE interrupt sends it
+    if(_tx_buffer->head != _tx_buffer->tail)
+    {
+      usart_dre_int(_usart, 1);
+    }
+  }
+
+  if(_dma_rx >= 0)
+  {
     oldSREG = SREG;
-    // clear interrupt flag until I'm done
-    // assigning pin stuff
     cli();
 
-    // pin re-mapping register and port/pin
-    // assignments
+    serial_dma_rx_register(this, false);
 
-    if(_usart == &SERIAL_0_USART_NAME)
+    _rx_buffer->head = dma_rx_pos(); // keep what was received
+
+    dmaFreeChannel(_dma_rx);
+    _dma_rx = -1;
+
+    usart_rxc_int(_usart, 1); // back to the RXC interrupt
+
+    SREG = oldSREG;
+  }
+
+  if(mode && _half_duplex) // half duplex needs the DRE and TXC interrupts, and switches RXEN
+  {
+    return false;
+  }
+
+  if((mode & SERIAL_DMA_RX) && (_rx_buffer->frame || _rx_buffer->bit9)) // gap framing and 9-bit need the RXC interrupt
+  {
+    return false;
+  }
+
+  if(mode & SERIAL_DMA_TX)
+  {
+    // CTS needs the DRE interrupt to stop sending, so no DMA with it
+    if(serial_cts_enabled(_port))
     {
-        bitTX = (SERIAL_0_TX_PIN_INDEX);
-        bitRX = (SERIAL_0_RX_PIN_INDEX);
-#ifdef SERIAL_0_REMAP
-        // enable re-mapping for this port
-        SERIAL_0_REMAP |= SERIAL_0_REMAP_BIT;
-#endif // SERIAL_0_REMAP
+      return false;
     }
-    else if(_usart == &SERIAL_1_USART_NAME)
+
+    _dma_tx = dmaAllocChannel();
+
+    if(_dma_tx < 0)
     {
-        bitTX = (SERIAL_1_TX_PIN_INDEX);
-        bitRX = (SERIAL_1_RX_PIN_INDEX);
-#ifdef SERIAL_1_REMAP
-        // enable re-mapping for this port
-        SERIAL_1_REMAP |= SERIAL_1_REMAP_BIT;
-#endif // SERIAL_0_REMAP
+      return false;
     }
-#ifdef SERIAL_2_PORT_NAME
-    else if(_usart == &SERIAL_2_USART_NAME)
-    {
-        bitTX = (SERIAL_2_TX_PIN_INDEX);
-        bitRX = (SERIAL_2_RX_PIN_INDEX);
-#ifdef SERIAL_2_REMAP
-        // enable re-mapping for this port
-        SERIAL_2_REMAP |= SERIAL_2_REMAP_BIT;
-#endif // SERIAL_2_REMAP
+
+    setup.pSrc = _tx_buffer->buffer; // assigned for each block
+    setup.pDest = &(_usart->DATA);
+    setup.wCount = 1;
+    setup.bAddrCtrl = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc
+                    | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    setup.bTrigger = usart_dma_trigger(_usart, 1);
+    setup.bBurst = DMA_CH_BURSTLEN_1BYTE_gc;
+    setup.bRepeat = 1;
+    setup.bFlags = DMA_SINGLE; // one byte per DRE
+
+    dmaSetup(_dma_tx, &setup);
+    dmaSetCallback(_dma_tx, serial_dma_tx_callback, this);
+
+    oldSREG = SREG;
+    cli();
+
+    // DMA takes over from the DRE interrupt.  If a byte is still in progress by the ISR,
+    // that's fine, since the ISR only ever writes to DATA when DRE is set
+    usart_dre_int(_usart, 0);
+
+    dma_tx_start();
+
+    SREG = oldSREG;
+  }
+
+  if(mode & SERIAL_DMA_RX)
+  {
+    // RTS is updated per received byte, which DMA can't do
+    if(_port < SERIAL_NUM_PORTS && serial_flow[_port].pRTS)
+    {
+      return false;
     }
-#endif // SERIAL_2_PORT_NAME
-#ifdef SERIAL_3_PORT_NAME
-    else if(_usart == &SERIAL_3_USART_NAME)
+
+    _dma_rx = dmaAllocChannel();
+
+    if(_dma_rx < 0)
     {
-        bitTX = (SERIAL_3_TX_PIN_INDEX);
-        bitRX = (SERIAL_3_RX_PIN_INDEX);
-#ifdef SERIAL_3_REMAP
-        // enable re-mapping for this port
-        SERIAL_3_REMAP |= SERIAL_3_REMAP_BIT;
-#endif // SERIAL_3_REMAP
+      return false;
     }
+
+    setup.pSrc = &(_usart->DATA);
+    setup.pDest = _rx_buffer->buffer;
+    setup.wCount = (unsigned int)_rx_buffer->mask + 1;
+    setup.bAddrCtrl = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc
+                    | DMA_CH_DESTRELOAD_BLOCK_gc | DMA_CH_DESTDIR_INC_gc;
+    setup.bTrigger = usart_dma_trigger(_usart, 0);
+    setup.bBurst = DMA_CH_BURSTLEN_1BYTE_gc;
+    setup.bRepeat = 0; // forever
+    setup.bFlags = DMA_SINGLE; // one byte per RXC
+
+    dmaSetup(_dma_rx, &setup);
+
+    oldSREG = SREG;
+    cli();
+
+    usart_rxc_int(_usart, 0); // no RXC interrupt
+
+    // anything in the buffer now is discarded, since the DMA starts at the beginning
+    _rx_buffer->head = 0;
+    _rx_buffer->tail = 0;
+    _rx_idle_pos = 0;
+    _rx_idle_count = 0;
+    _rx_idle = 0;
+    _rx_active = 0;
+
+    dmaStart(_dma_rx);
+
+    serial_dma_rx_register(this, true);
+
+    SREG = oldSREG;
+  }
+
+  return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//                ____         _      _                                     //
+//               | __ )  _ __ (_)  __| |  __ _   ___                        //
+//               |  _ \ | '__|| | / _` | / _` | / _ \                       //
+//               | |_) || |   | || (_| || (_| ||  __/                       //
+//               |____/ |_|   |_| \__,_| \__, | \___|                       //
+//                                       |___/                              //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+// A bridge connects 2 ports in their RXC ISRs.  Each port gets an RX hook that hands the byte
+// straight to the other port's transmitter - into DATA when the transmitter is idle, otherwise
+// into its TX buffer with DRE (or DMA) armed.  Nothing goes through the RX buffers, and 'loop()'
+// is not involved at all, so it keeps up with full baud in both directions.  If the TX buffer
+// of the slower side fills up, bytes are dropped (see 'txDropped()').
+//
+// It ends after a number of bytes, or when the idle timer (the TCD0 CCD 'tick' used by DMA RX)
+// counts the idle timeout without data, or with 'endBridge()'.
+
+// called with interrupts disabled
+static void serial_bridge_stop(void)
+{
+  serial_bridge.bActive = 0;
+
+  serial_bridge.pA->setRxHook(NULL, NULL);
+  serial_bridge.pB->setRxHook(NULL, NULL);
+
+  serial_tick_update();
+}
+
+static bool serial_bridge_hook(void *pCtx, uint8_t c, uint8_t stat)
+{
+  // the bridge is transparent, so a byte with a framing/parity error ('stat') is passed on as it
+  // is.  Dropping it would only shift the problem to the other side, which can't see the error
+  (void)stat;
+
+  ((HardwareSerial *)pCtx)->tx_isr(c);
+
+  serial_bridge.wIdleCount = 0;
+
+  if(serial_bridge.ulCount && !--serial_bridge.ulCount)
+  {
+    serial_bridge_stop();
+  }
+
+  return true;
+}
+
+static void serial_bridge_tick(void)
+{
+uint8_t oldSREG = SREG;
+
+  cli(); // the RXC ISRs (higher level) change 'wIdleCount' too
+
+  if(serial_bridge.bActive && serial_bridge.wIdleMs
+     && ++serial_bridge.wIdleCount >= serial_bridge.wIdleMs)
+  {
+    serial_bridge_stop();
+  }
+
+  SREG = oldSREG;
+}
+
+// send one byte from an ISR (interrupts are disabled).  Returns 'false' if the TX buffer is full
+bool HardwareSerial::tx_isr(uint8_t c)
+{
+serial_index_t i1;
+
+  if(_half_duplex && !_hd_tx)
+  {
+    hd_tx_start();
+  }
+
+  if(_dma_tx < 0 && !serial_cts_enabled(_port)
+     && _tx_buffer->head == _tx_buffer->tail && (_usart->STATUS & _BV(USART_DREIF_bp)))
+  {
+    _usart->STATUS = _BV(USART_TXCIF_bp); // for 'flush()'
+    _usart->DATA = c; // nothing waiting, so straight into DATA
+
+    transmitting = true;
+
+    return true;
+  }
+
+  i1 = (_tx_buffer->head + 1) & _tx_buffer->mask;
+
+  if(i1 == _tx_buffer->tail) // full, and I can't wait here
+  {
+    _tx_dropped++;
+
+    return false;
+  }
+
+  _tx_buffer->buffer[_tx_buffer->head] = c;
+  _tx_buffer->head = i1;
+
+  if(_dma_tx >= 0)
+  {
+    dma_tx_start();
+  }
+  else
+  {
+    usart_dre_int(_usart, 1);
+
+    transmitting = true;
+    _usart->STATUS = _BV(USART_TXCIF_bp); // other bits must be written as zero
+  }
+
+  return true;
+}
+
+bool HardwareSerial::bridge(HardwareSerial &other, unsigned long count, uint16_t idleMs)
+{
+uint8_t oldSREG;
+
+  // DMA RX has no RXC interrupt, and 'onReceive()' would lose its hook
+  if(&other == this || _dma_rx >= 0 || other._dma_rx >= 0 || _rx_cb || other._rx_cb
+     || _port >= SERIAL_NUM_PORTS || other._port >= SERIAL_NUM_PORTS)
+  {
+    return false;
+  }
+
+  endBridge(); // only one at a time
+
+  oldSREG = SREG;
+  cli();
+
+  serial_bridge.pA = this;
+  serial_bridge.pB = &other;
+  serial_bridge.ulCount = count;
+  serial_bridge.wIdleMs = idleMs;
+  serial_bridge.wIdleCount = 0;
+  serial_bridge.bActive = 1;
+
+  setRxHook(serial_bridge_hook, &other); // what I receive, 'other' sends
+  other.setRxHook(serial_bridge_hook, this);
+
+  serial_tick_update();
+
+  SREG = oldSREG;
+
+  return true;
+}
+
+void HardwareSerial::endBridge(void)
+{
+uint8_t oldSREG = SREG;
+
+  cli();
+
+  if(serial_bridge.bActive)
+  {
+    serial_bridge_stop();
+  }
+
+  SREG = oldSREG;
+}
+
+bool HardwareSerial::bridging(void)
+{
+  return serial_bridge.bActive && (serial_bridge.pA == this || serial_bridge.pB == this);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//    ____               _         _   _____                     _          //
+//   / ___|   ___  _ __ (_)  __ _ | | | ____|__   __ ___  _ __  | |_  ___   //
+//   \___ \  / _ \| '__|| | / _` || | |  _|  \ \ / // _ \| '_ \ | __|/ __|  //
+//    ___) ||  __/| |   | || (_| || | | |___  \ V /|  __/| | | || |_ \__ \  //
+//   |____/  \___||_|   |_| \__,_||_| |_____|  \_/  \___||_| |_| \__||___/  //
+//                                                                          //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+void serialEvent() __attribute__((weak));
+void serialEvent() {}
+#define serialEvent_implemented
+
+void serialEvent2() __attribute__((weak));
+void serialEvent2() {}
+#define serialEvent2_implemented
+
+#ifdef SERIAL_2_PORT_NAME
+void serialEvent3() __attribute__((weak));
+void serialEvent3() {}
+#define serialEvent3_implemented
+#endif // SERIAL_2_PORT_NAME
+
+#ifdef SERIAL_3_PORT_NAME
+void serialEvent4() __attribute__((weak));
+void serialEvent4() {}
+#define serialEvent4_implemented
 #endif // SERIAL_3_PORT_NAME
+
 #ifdef SERIAL_4_PORT_NAME
-    else if(_usart == &SERIAL_4_USART_NAME)
+void serialEvent5() __attribute__((weak));
+void serialEvent5() {}
+#define serialEvent5_implemented
+#endif // SERIAL_4_PORT_NAME
+
+#ifdef SERIAL_5_PORT_NAME
+void serialEvent6() __attribute__((weak));
+void serialEvent6() {}
+#define serialEvent6_implemented
+#endif // SERIAL_5_PORT_NAME
+
+#ifdef SERIAL_6_PORT_NAME
+void serialEvent7() __attribute__((weak));
+void serialEvent7() {}
+#define serialEvent7_implemented
+#endif // SERIAL_6_PORT_NAME
+
+#ifdef SERIAL_7_PORT_NAME
+void serialEvent8() __attribute__((weak));
+void serialEvent8() {}
+#define serialEvent8_implemented
+#endif // SERIAL_7_PORT_NAME
+
+// The RXC ISRs (and the DMA RX idle timer) set a bit in 'SERIAL_EVENT_FLAGS' for every byte, so
+// when nothing was received, this is just one test.  If the handler leaves data in the buffer,
+// the bit is set again, so it's called again next time, same as before.
+void serialEventRun(void)
+{
+uint8_t bFlags;
+uint8_t oldSREG;
+
+
+  if(!SERIAL_EVENT_FLAGS) // the usual case
+  {
+    return;
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  bFlags = SERIAL_EVENT_FLAGS;
+  SERIAL_EVENT_FLAGS = 0;
+
+  SREG = oldSREG;
+
+#ifdef serialEvent_implemented
+#ifdef USBCON
+#define SERIAL_EVENT_OBJECT Serial1
+#else // normal
+#define SERIAL_EVENT_OBJECT Serial
+#endif // USBCON, normal
+  if((bFlags & _BV(0)) && SERIAL_EVENT_OBJECT.available())
+  {
+    serialEvent();
+
+    if(SERIAL_EVENT_OBJECT.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(0);
+    }
+  }
+#undef SERIAL_EVENT_OBJECT
+#endif // serialEvent_implemented
+
+#ifdef serialEvent2_implemented
+  if((bFlags & _BV(1)) && Serial2.available())
+  {
+    serialEvent2();
+
+    if(Serial2.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(1);
+    }
+  }
+#endif // serialEvent2_implemented
+
+#ifdef serialEvent3_implemented
+  if((bFlags & _BV(2)) && Serial3.available())
+  {
+    serialEvent3();
+
+    if(Serial3.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(2);
+    }
+  }
+#endif // serialEvent3_implemented
+
+#ifdef serialEvent4_implemented
+  if((bFlags & _BV(3)) && Serial4.available())
+  {
+    serialEvent4();
+
+    if(Serial4.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(3);
+    }
+  }
+#endif // serialEvent4_implemented
+
+#ifdef serialEvent5_implemented
+  if((bFlags & _BV(4)) && Serial5.available())
+  {
+    serialEvent5();
+
+    if(Serial5.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(4);
+    }
+  }
+#endif // serialEvent5_implemented
+
+#ifdef serialEvent6_implemented
+  if((bFlags & _BV(5)) && Serial6.available())
+  {
+    serialEvent6();
+
+    if(Serial6.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(5);
+    }
+  }
+#endif // serialEvent6_implemented
+
+#ifdef serialEvent7_implemented
+  if((bFlags & _BV(6)) && Serial7.available())
+  {
+    serialEvent7();
+
+    if(Serial7.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(6);
+    }
+  }
+#endif // serialEvent7_implemented
+
+#ifdef serialEvent8_implemented
+  if((bFlags & _BV(7)) && Serial8.available())
+  {
+    serialEvent8();
+
+    if(Serial8.available()) // still something left
+    {
+      SERIAL_EVENT_FLAGS |= _BV(7);
+    }
+  }
+#endif // serialEvent8_implemented
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////
+//                                                                               //
+//   ____                     _   ____         _           ____        _         //
+//  | __ )   __ _  _   _   __| | |  _ \  __ _ | |_  ___   / ___| __ _ | |  ___   //
+//  |  _ \  / _` || | | | / _` | | |_) |/ _` || __|/ _ \ | |    / _` || | / __|  //
+//  | |_) || (_| || |_| || (_| | |  _ <| (_| || |_|  __/ | |___| (_| || || (__   //
+//  |____/  \__,_| \__,_| \__,_| |_| \_\\__,_| \__|\___|  \____|\__,_||_| \___|  //
+//                                                                               //
+//                                                                               //
+///////////////////////////////////////////////////////////////////////////////////
+
+// Baud rate calculation - see A manual sect 19.3.1 and table 19-1.  The baud rate generator
+// has a 12-bit BSEL and a 4-bit signed BSCALE (-7 to +7), with CLK2X selecting 8 or 16 samples
+// per bit.  For a positive BSCALE the clock is divided by 2^BSCALE, for a negative BSCALE it's
+// a 'fractional' divider with BSEL in units of 2^BSCALE.
+//
+//   X = clk_2x ? 8 : 16    bscale >= 0:  bsel = F_CPU / ( (2 ^ bscale) * X * baud) - 1
+//                                        baud = F_CPU / ( (2 ^ bscale) * X * (bsel + 1) )
+//                          bscale < 0:   bsel = (1 / (2 ^ (bscale))) * (F_CPU / (X * baud) - 1)
+//                                        baud = F_CPU / ( X * (((2 ^ bscale) * bsel) + 1) )
+//
+// Every BSCALE is tried for 1x and 2x, and the one with the smallest error wins.  On a tie,
+// 1x is used, since 16 samples per bit are more tolerant of noise and clock differences, and
+// a positive BSCALE is used, since the fractional divider adds a little jitter to the bits.
+// The limit is F_CPU / 8 with 2x, which is 2Mbaud at 16MHz (4Mbaud at 32MHz).
+//
+// This takes about 2ms of 32-bit divides at 16MHz, which only happens in 'begin()'.
+
+bool serialBaudCalc(unsigned long baud, SERIAL_BAUD *pBaud)
+{
+unsigned long ulBest = 0xffffffffUL, ulDiv, ulNum, ulActual, ulDiff;
+uint16_t wBsel;
+int8_t iScale;
+uint8_t bX;
+
+
+  if(!baud || baud > F_CPU / 8)
+  {
+    return false;
+  }
+
+  for(bX = 16; bX >= 8 && ulBest; bX >>= 1) // 1x first, then 2x
+  {
+    if(baud > F_CPU / bX)
+    {
+      continue; // too fast for 1x
+    }
+
+    for(iScale = 7; iScale >= -7 && ulBest; iScale--) // non-fractional first
+    {
+      if(iScale >= 0)
+      {
+        ulDiv = ((unsigned long)bX * baud) << iScale;
+        ulNum = (F_CPU + ulDiv / 2) / ulDiv; // bsel + 1, rounded
+
+        if(!ulNum || ulNum > 4096)
+        {
+          continue;
+        }
+
+        wBsel = (uint16_t)(ulNum - 1);
+
+        ulDiv = ((unsigned long)bX * ulNum) << iScale;
+        ulActual = (F_CPU + ulDiv / 2) / ulDiv;
+      }
+      else
+      {
+        // everything is multiplied by 2^-bscale, so it stays in integers.
+        // F_CPU * 128 still fits in 32 bits for 32MHz
+        ulDiv = (unsigned long)bX * baud;
+        ulNum = (((unsigned long)F_CPU << (-iScale)) + ulDiv / 2) / ulDiv; // bsel + 2^-bscale
+
+        if(ulNum <= (1UL << (-iScale)))
+        {
+          continue; // bsel would be zero
+        }
+
+        ulNum -= 1UL << (-iScale);
+
+        if(ulNum > 4095)
+        {
+          continue;
+        }
+
+        wBsel = (uint16_t)ulNum;
+
+        ulDiv = (unsigned long)bX * (ulNum + (1UL << (-iScale)));
+        ulActual = (((unsigned long)F_CPU << (-iScale)) + ulDiv / 2) / ulDiv;
+      }
+
+      ulDiff = ulActual > baud ? ulActual - baud : baud - ulActual;
+
+      if(ulDiff < ulBest)
+      {
+        ulBest = ulDiff;
+
+        pBaud->wSetting = ((uint16_t)(iScale & 0xf) << 12) | wBsel; // BAUDCTRLB:BAUDCTRLA
+        pBaud->bClk2x = bX == 8 ? _BV(USART_CLK2X_bp) : 0;
+        pBaud->ulActual = ulActual;
+      }
+    }
+  }
+
+  if(ulBest == 0xffffffffUL)
+  {
+    return false;
+  }
+
+  // error in ppm, without overflowing 32 bits
+  if(ulBest >= baud)
+  {
+    pBaud->ulPPM = 1000000UL;
+  }
+  else if(ulBest < 4295)
+  {
+    pBaud->ulPPM = ulBest * 1000000UL / baud;
+  }
+  else
+  {
+    pBaud->ulPPM = ulBest * 1000UL / (baud / 1000); // 'baud' is at least 4295 here
+  }
+
+  return true;
+}
+
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                         //
+//   _   _                  _                             ____               _         _   //
+//  | | | |  __ _  _ __  __| |__      __ __ _  _ __  ___ / ___|   ___  _ __ (_)  __ _ | |  //
+//  | |_| | / _` || '__|/ _` |\ \ /\ / // _` || '__|/ _ \\___ \  / _ \| '__|| | / _` || |  //
+//  |  _  || (_| || |  | (_| | \ V  V /| (_| || |  |  __/ ___) ||  __/| |   | || (_| || |  //
+//  |_| |_| \__,_||_|   \__,_|  \_/\_/  \__,_||_|   \___||____/  \___||_|   |_| \__,_||_|  //
+//                                                                                         //
+//                                                                                         //
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// Constructors ////////////////////////////////////////////////////////////////
+
+/*
+void HardwareSerial::init(
+    ring_buffer *rx_buffer0,
+    ring_buffer *tx_buffer0,
+    uint16_t usart0)
+{
+    register ring_buffer *pR = rx_buffer0;
+    register ring_buffer *pT = tx_buffer0;
+
+    _rx_buffer = pR; //rx_buffer0;
+    _tx_buffer = pT; //tx_buffer0;
+    _usart = (volatile USART_t *)usart0;
+
+    pR->head = 0;
+    pR->tail = 0;
+    pT->head = 0;
+    pT->tail = 0;
+    // memset(rx_buffer0, 0, sizeof(*rx_buffer0));
+    // memset(tx_buffer0, 0, sizeof(*tx_buffer0));
+}
+*/
+
+HardwareSerial::HardwareSerial(
+    ring_buffer *rx_buffer0,
+    ring_buffer *tx_buffer0,
+    SERIAL_STATS *stats0,
+    uint16_t usart0) /*__attribute__ ((noinline))*/
+{
+    register ring_buffer *pR = rx_buffer0;
+    register ring_buffer *pT = tx_buffer0;
+
+    // init(rx_buffer0, tx_buffer0, usart0); this is larger code, left for reference
+
+    _rx_buffer = pR; //rx_buffer0;
+    _tx_buffer = pT; //tx_buffer0;
+    _usart = (volatile USART_t *)usart0;
+    _stats = stats0;
+    _port = serial_port_index(pR);
+    _ctrl_rx = NULL;
+    _ctrl_tx = NULL;
+    _tx_port = NULL;
+    _tx_bit = 0;
+    _half_duplex = 0;
+    _hd_tx = 0;
+    _multidrop = 0;
+    _md_addr = 0;
+    _rx_cb = NULL;
+    _rx_cb_ctx = NULL;
+
+    _dma_tx = -1;
+    _dma_tx_len = 0;
+    _dma_rx = -1;
+    _rx_idle_ms = 2;
+    _rx_idle_count = 0;
+    _rx_idle_pos = 0;
+    _rx_idle = 0;
+    _rx_active = 0;
+    _tx_policy = SERIAL_TX_BLOCK;
+    _tx_dropped = 0;
+    _baud_actual = 0;
+    _baud_ppm = 0;
+
+    pR->head = 0;
+    pR->tail = 0;
+    pT->head = 0;
+    pT->tail = 0;
+    // memset(rx_buffer0, 0, sizeof(*rx_buffer0));
+    // memset(tx_buffer0, 0, sizeof(*tx_buffer0));
+}
+
+// Public Methods //////////////////////////////////////////////////////////////
+
+// 'D' manual, section 19.5
+// USART Initialization
+// USART initialization should use the following sequence:
+// 1. Set the TxD pin value high, and optionally set the XCK pin low.
+// 2. Set the TxD and optionally the XCK pin as output.
+// 3. Set the baud rate and frame format.
+// 4. Set the mode of operation (enables XCK pin output in synchronous mode).
+// 5. Enable the transmitter or the receiver, depending on the usage.
+// For interrupt-driven USART operation, global interrupts should be disabled during the initialization.
+// Before doing a re-initialization with a changed baud rate or frame format, be sure that there are no ongoing transmissions
+// while the registers are changed.
+
+void HardwareSerial::begin(
+    unsigned long baud)
+{
+    begin(baud, SERIAL_8N1);
+}
+
+// change the size of a ring buffer.  The size is rounded UP to a power of 2 (at most
+// SERIAL_BUFFER_MAX).  If it fits in the static buffer, that is used, otherwise it comes
+// from the heap.  If 'malloc()' fails, it stays with the static buffer.  Any data is lost.
+static void ring_buffer_resize(ring_buffer *pB, unsigned int iSize)
+{
+unsigned int iPow;
+unsigned char *pNew;
+
+  if(!iSize)
+  {
+    return; // keep what it has
+  }
+
+  for(iPow=2; iPow < iSize && iPow < SERIAL_BUFFER_MAX; iPow <<= 1) { }
+
+  if(pB->buffer != pB->static_buffer) // back to the static buffer first
+  {
+    free(pB->buffer);
+
+    pB->buffer = pB->static_buffer;
+    pB->mask = pB->static_mask;
+  }
+
+  if(iPow - 1 <= pB->static_mask)
+  {
+    pB->mask = (serial_index_t)(iPow - 1); // same buffer, smaller mask
+  }
+  else
+  {
+    pNew = (unsigned char *)malloc(iPow);
+
+    if(pNew)
+    {
+      pB->buffer = pNew;
+      pB->mask = (serial_index_t)(iPow - 1);
+    }
+  }
+
+  pB->head = 0;
+  pB->tail = 0;
+
+  if(pB->frame) // positions are no longer valid
+  {
+    pB->frame->bTail = pB->frame->bHead;
+  }
+}
+
+// 9-bit frames - the RX buffer gets a bit for each byte, for RXB8.  returns 'false' if there's no memory
+static bool ring_buffer_bit9(ring_buffer *pB, bool bOn)
+{
+unsigned int iLen = ((unsigned int)pB->mask + 8) >> 3;
+
+  if(pB->bit9) // the buffer size might have changed, so always start over
+  {
+    free(pB->bit9);
+    pB->bit9 = NULL;
+  }
+
+  if(!bOn)
+  {
+    return true;
+  }
+
+  pB->bit9 = (unsigned char *)malloc(iLen);
+
+  if(!pB->bit9)
+  {
+    return false;
+  }
+
+  memset(pB->bit9, 0, iLen);
+
+  return true;
+}
+
+// begin with buffer sizes - '0' keeps the current size.  See 'ring_buffer_resize()'
+void HardwareSerial::begin(
+    unsigned long baud,
+    byte config,
+    unsigned int rxSize,
+    unsigned int txSize)
+{
+    uint8_t oldSREG, bDMA;
+
+    // the DMA channels point at the old buffers, so DMA is off while resizing and then back on
+    bDMA = (_dma_tx >= 0 ? SERIAL_DMA_TX : 0) | (_dma_rx >= 0 ? SERIAL_DMA_RX : 0);
+
+    if(bDMA)
+    {
+        enableDMA(0);
+    }
+
+    oldSREG = SREG;
+    cli(); // the ISRs must not see a half-changed buffer
+
+    _usart->CTRLA = 0; // no interrupts until 'begin()' turns them on again
+
+    ring_buffer_resize(_rx_buffer, rxSize);
+    ring_buffer_resize(_tx_buffer, txSize);
+
+    SREG = oldSREG;
+
+    begin(baud, config);
+
+    if(bDMA && _baud_actual)
+    {
+        enableDMA(bDMA); // the same mode as before, with the new buffers
+    }
+}
+
+void HardwareSerial::begin(
+    unsigned long baud,
+    byte config)
+{
+    SERIAL_BAUD sBaud;
+    uint16_t baud_setting;
+    uint8_t use_u2x;
+    uint8_t bit, bitTX=3, bitRX=2; // defaults
+    volatile uint8_t *reg;
+    volatile uint8_t *out;
+    volatile uint8_t *ctrlT;
+    volatile uint8_t *ctrlR;
+    uint8_t oldSREG, bDMA;
+    PORT_t *pRTS = NULL, *pCTS = NULL;
+    uint8_t bRTS = 0, bCTS = 0;
+
+
+    // baud rate calc - table 19-1 (page 211)
+    // for calculation formulae.  This also
+    // picks CLK2X (bit 2 in CTRLB, section
+    // 19.14.4) when it gives a smaller error
+    if(!serialBaudCalc(baud, &sBaud))
+    {
+        _baud_actual = 0; // not possible, leave the port alone
+        _baud_ppm = 0;
+
+        return;
+    }
+
+    use_u2x = sBaud.bClk2x;
+    baud_setting = sBaud.wSetting;
+
+    _baud_actual = sBaud.ulActual;
+    _baud_ppm = sBaud.ulPPM;
+
+    // the RXC interrupt is turned on below, and it must never read DATA while a DMA RX channel
+    // does, so DMA is off while the port is set up, and back on (same mode) at the end
+    bDMA = (_dma_tx >= 0 ? SERIAL_DMA_TX : 0) | (_dma_rx >= 0 ? SERIAL_DMA_RX : 0);
+
+    if(bDMA)
+    {
+        enableDMA(0);
+    }
+
+    // pre-assign
+    transmitting = false;
+
+    // save old to restore interrupts as they
+    // were
+    oldSREG = SREG;
+    // clear interrupt flag until I'm done
+    // assigning pin stuff
+    cli();
+
+    // pin re-mapping register and port/pin
+    // assignments
+
+    if(_usart == &SERIAL_0_USART_NAME)
+    {
+        bitTX = (SERIAL_0_TX_PIN_INDEX);
+        bitRX = (SERIAL_0_RX_PIN_INDEX);
+#ifdef SERIAL_0_REMAP
+        // enable re-mapping for this port
+        SERIAL_0_REMAP |= SERIAL_0_REMAP_BIT;
+#endif // SERIAL_0_REMAP
+    }
+    else if(_usart == &SERIAL_1_USART_NAME)
+    {
+        bitTX = (SERIAL_1_TX_PIN_INDEX);
+        bitRX = (SERIAL_1_RX_PIN_INDEX);
+#ifdef SERIAL_1_REMAP
+        // enable re-mapping for this port
+        SERIAL_1_REMAP |= SERIAL_1_REMAP_BIT;
+#endif // SERIAL_0_REMAP
+    }
+#ifdef SERIAL_2_PORT_NAME
+    else if(_usart == &SERIAL_2_USART_NAME)
+    {
+        bitTX = (SERIAL_2_TX_PIN_INDEX);
+        bitRX = (SERIAL_2_RX_PIN_INDEX);
+#ifdef SERIAL_2_REMAP
+        // enable re-mapping for this port
+        SERIAL_2_REMAP |= SERIAL_2_REMAP_BIT;
+#endif // SERIAL_2_REMAP
+    }
+#endif // SERIAL_2_PORT_NAME
+#ifdef SERIAL_3_PORT_NAME
+    else if(_usart == &SERIAL_3_USART_NAME)
+    {
+        bitTX = (SERIAL_3_TX_PIN_INDEX);
+        bitRX = (SERIAL_3_RX_PIN_INDEX);
+#ifdef SERIAL_3_REMAP
+        // enable re-mapping for this port
+        SERIAL_3_REMAP |= SERIAL_3_REMAP_BIT;
+#endif // SERIAL_3_REMAP
+    }
+#endif // SERIAL_3_PORT_NAME
+#ifdef SERIAL_4_PORT_NAME
+    else if(_usart == &SERIAL_4_USART_NAME)
+    {
+        bitTX = (SERIAL_4_TX_PIN_INDEX);
+        bitRX = (SERIAL_4_RX_PIN_INDEX);
+#ifdef SERIAL_4_REMAP
+        // NOTE: no remap for serial 4 through
+        // Serial 7
+#warning pin remap not supported for 'SERIAL_4'
+#endif // SERIAL_4_REMAP
+    }
+#endif // SERIAL_4_PORT_NAME
+#ifdef SERIAL_5_PORT_NAME
+    else if(_usart == &SERIAL_5_USART_NAME)
+    {
+        bitTX = (SERIAL_5_TX_PIN_INDEX);
+        bitRX = (SERIAL_5_RX_PIN_INDEX);
+#ifdef SERIAL_5_REMAP
+        // NOTE: no remap for serial 5
+        // through Serial 7
+#warning pin remap not supported for 'SERIAL_5'
+#endif // SERIAL_5_REMAP
+    }
+#endif // SERIAL_5_PORT_NAME
+#ifdef SERIAL_6_PORT_NAME
+    else if(_usart == &SERIAL_6_USART_NAME)
+    {
+        bitTX = (SERIAL_6_TX_PIN_INDEX);
+        bitRX = (SERIAL_6_RX_PIN_INDEX);
+#ifdef SERIAL_6_REMAP
+        // NOTE: no remap for serial 6
+        // through Serial 7
+#warning pin remap not supported for 'SERIAL_6'
+#endif // SERIAL_6_REMAP
+    }
+#endif // SERIAL_6_PORT_NAME
+#ifdef SERIAL_7_PORT_NAME
+    else if(_usart == &SERIAL_7_USART_NAME)
+    {
+        bitTX = (SERIAL_7_TX_PIN_INDEX);
+        bitRX = (SERIAL_7_RX_PIN_INDEX);
+#ifdef SERIAL_7_REMAP
+        // NOTE: no remap for serial 7
+        // through Serial 7
+#warning pin remap not supported for 'SERIAL_7'
+#endif // SERIAL_7_REMAP
+    }
+#endif // SERIAL_7_PORT_NAME
+    else
+    {
+        // not valid
+        goto exit_point;
+    }
+
+// USART setup - for existing ports only
+// (otherwise we just return)
+
+    if(_usart == &USARTD0
+#ifdef USARTD1
+        || _usart == &USARTD1
+#endif
+        )
+    {
+        reg = &PORTD_DIR;
+        out = &PORTD_OUT;
+        ctrlT = &PORTD_PIN0CTRL + bitTX;
+        ctrlR = &PORTD_PIN0CTRL + bitRX;
+    }
+    else if(_usart == &USARTC0
+#ifdef USARTC1
+        || _usart == &USARTC1
+#endif
+        )
+    {
+        reg = &PORTC_DIR;
+        out = &PORTC_OUT;
+        ctrlT = &PORTC_PIN0CTRL + bitTX;
+        ctrlR = &PORTC_PIN0CTRL + bitRX;
+    }
+#ifdef USARTE0
+    else if(_usart == &USARTE0
+#ifdef USARTE1
+        || _usart == &USARTE1
+#endif
+        )
+    {
+        reg = &PORTE_DIR;
+        out = &PORTE_OUT;
+        ctrlT = &PORTE_PIN0CTRL + bitTX;
+        ctrlR = &PORTE_PIN0CTRL + bitRX;
+    }
+#endif
+#ifdef USARTF0
+    else if(_usart == &USARTF0
+#ifdef USARTF1
+        || _usart == &USARTF1
+#endif
+        )
+    {
+        reg = &PORTF_DIR;
+        out = &PORTF_OUT;
+        ctrlT = &PORTF_PIN0CTRL + bitTX;
+        ctrlR = &PORTF_PIN0CTRL + bitRX;
+    }
+#endif
+    else
+    {
+         // not valid
+        goto exit_point;
+    }
+
+    _ctrl_tx = ctrlT; // for 'setInverted()'
+    _ctrl_rx = ctrlR;
+    _tx_port = (PORT_t *)reg; // DIR is the first register, for 'setHalfDuplex()'
+    _tx_bit = 1 << bitTX;
+
+    if(_half_duplex) // the pins and CTRLA are set up from scratch, so it's off now
+    {
+        serial_half_duplex[_port] = NULL;
+        _half_duplex = 0;
+        _hd_tx = 0;
+    }
+
+    if(_multidrop) // plain 'begin()' after 'beginMultidrop()'
+    {
+        setRxHook(NULL, NULL);
+        _multidrop = 0;
+    }
+
+    // port config, transmit bit
+    bit = 1 << bitTX;
+    *ctrlT = 0; // trigger on BOTH, totem, no pullup
+    *out |= bit; // set to 'HIGH'
+    *reg |= bit; // set as output
+
+    // port config, receive bit
+    bit = 1 << bitRX;
+    *ctrlR = 0; // triger on BOTH, no pullup
+    *out &= ~bit; // off
+    *reg &= ~bit; // set as input
+
+    // section 19.4.4
+    // enable clock 2x when set
+    // (everything else disabled)
+    _usart->CTRLB = use_u2x;
+
+
+    // section 19.14.5 - USART mode, parity,
+    // bits
+    // CMODE 7:6   00 [async]
+    // PMODE 5:4   00=none  10=even 11=odd
+    // SBMODE 3    0=1 stop  1=2 stop
+    // CHSIZE 2:0  000=5 bit 001=6 bit  010=7 bit  011=8 bit  111=9 bit
+    _usart->CTRLC = config & ~(_BV(USART_CMODE1_bp)|_BV(USART_CMODE0_bp)); // make sure bits 6 and 7 are cleared
+
+    // 9-bit frames keep RXB8 for every byte in the RX buffer, see 'read9()'
+    ring_buffer_bit9(_rx_buffer, (config & USART_CHSIZE_gm) == USART_CHSIZE_9BIT_gc);
+
+    if(_rx_cb && (config & USART_CHSIZE_gm) == USART_CHSIZE_9BIT_gc) // the callback has no bit 8
+    {
+        onReceive(NULL); // back to the RX buffer, where 'read9()' has it
+    }
+#ifdef USARTD0_CTRLD
+    // E5 has this register, must assign to zero
+    _usart->CTRLD = 0;
+#endif
+
+    // assign the baud_setting, a.k.a. ubbr
+    // (USART Baud Rate Register)
+    _usart->BAUDCTRLA = (uint8_t)(baud_setting & 0xff);
+    _usart->BAUDCTRLB = (uint8_t)(baud_setting >> 8);
+
+    // section 19.4.4
+    // enable RX, enable TX.
+    // Bit 2 will be 1 or 0 based on
+    // clock 2x/1x.  multi-processor disabled.
+    // bit 9 = 0
+    _usart->CTRLB = use_u2x | _BV(USART_RXEN_bp) | _BV(USART_TXEN_bp);
+
+    // priority 3 for RX interrupts.
+    // DRE and TX interrupts OFF (for now).
+    _usart->CTRLA = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp);
+
+    // flow control pins from 'pins_arduino.h' (if any), with the default watermarks
+    // for the current buffer size.  'setFlowControl()' changes them
+#ifdef SERIAL_0_RTS_ENABLED
+    if(_port == 0)
+    {
+        pRTS = SERIAL_0_RTS_PORT;
+        bRTS = SERIAL_0_RTS_PIN;
+    }
+#endif // SERIAL_0_RTS_ENABLED
+#ifdef SERIAL_0_CTS_ENABLED
+    if(_port == 0)
+    {
+        pCTS = SERIAL_0_CTS_PORT;
+        bCTS = SERIAL_0_CTS_PIN;
+    }
+#endif // SERIAL_0_CTS_ENABLED
+#ifdef SERIAL_1_RTS_ENABLED
+    if(_port == 1)
+    {
+        pRTS = SERIAL_1_RTS_PORT;
+        bRTS = SERIAL_1_RTS_PIN;
+    }
+#endif // SERIAL_1_RTS_ENABLED
+#ifdef SERIAL_1_CTS_ENABLED
+    if(_port == 1)
+    {
+        pCTS = SERIAL_1_CTS_PORT;
+        bCTS = SERIAL_1_CTS_PIN;
+    }
+#endif // SERIAL_1_CTS_ENABLED
+
+    flow_set(pRTS, bRTS, pCTS, bCTS, 0, 0);
+
+exit_point:
+    // restore interrupt flag
+    // (now that I'm done assigning things)
+    SREG = oldSREG;
+
+    // 9-bit frames (or gap framing) need the RXC interrupt, then only TX goes back to DMA
+    if(bDMA && !enableDMA(bDMA) && (bDMA & SERIAL_DMA_TX))
+    {
+        enableDMA(SERIAL_DMA_TX);
+    }
+}
+
+// Auto baud - the RX pin is connected to an event channel, and every edge captures the count
+// of a timer that runs at (nearly) F_CPU (A manual sect 6 and 14.6.1).  The capture buffer is 2
+// deep, so polling keeps up even with an interrupt in between.  The shortest time between 2 edges
+// is one bit time, IF the data has a single '0' or '1' bit somewhere (most data does, 'U' and
+// '$' do).  Measuring stops after the first frame (SERIAL_AUTOBAUD_EDGES edges, 10 bit times of
+// the shortest pulse, or the end of a burst), then the candidate with the closest bit time wins.
+// The receiver is switched on once the line was idle (HIGH) for a whole frame at the new rate,
+// so that it starts with a start bit.  Back to back data is lost until there is such a gap.
+//
+// The timer is claimed with 'timerClaim()' for the measurement (default TCE0 - softPWM, 'tone()'
+// and SoftwareSerial use it as well, so it fails while one of them has it).  Define
+// SERIAL_AUTOBAUD_TIMER, SERIAL_AUTOBAUD_EVSYS_MUX and SERIAL_AUTOBAUD_EVSEL in 'pins_arduino.h'
+// to use another one.
+
+#ifndef SERIAL_AUTOBAUD_TIMER
+#define SERIAL_AUTOBAUD_TIMER TCE0
+#define SERIAL_AUTOBAUD_EVSYS_MUX EVSYS_CH7MUX
+#define SERIAL_AUTOBAUD_EVSEL TC_EVSEL_CH7_gc
+#endif // SERIAL_AUTOBAUD_TIMER
+
+#define SERIAL_AUTOBAUD_EDGES 10  /* the most edges one 8N1 frame can have ('U'), start bit included */
+#define SERIAL_AUTOBAUD_FRAME_BITS 10 /* bit times in an 8N1 frame - measuring ends after that */
+#define SERIAL_AUTOBAUD_IDLE_BITS 12 /* idle time before the receiver starts, longest frame is 12 bits */
+#define SERIAL_AUTOBAUD_TOLERANCE 8 /* bit time must match within 1/8 (12.5%) */
+
+unsigned long HardwareSerial::beginAuto(
+    const unsigned long *candidates,
+    uint8_t config,
+    unsigned long timeoutMs)
+{
+    SERIAL_BAUD sBaud;
+    PORT_t *pPort;
+    uint8_t bPin, bEdges, bDiv, bClk, i1, bBest;
+    uint16_t wNow, wLast = 0, wFirst = 0, wDiff, wMin, wIdle;
+    unsigned long ulStart, ulSlow, ulBit, ulErr, ulBestErr, ulRval = 0;
+    uint8_t oldSREG;
+
+
+    if(!candidates || !candidates[0])
+    {
+        return 0;
+    }
+
+    begin(candidates[0], config); // pins, frame format, and the fallback baud rate
+
+    if(!_ctrl_rx || !timerClaim(&SERIAL_AUTOBAUD_TIMER, TIMER_OWNER_AUTOBAUD)) // timer in use
+    {
+        return 0;
+    }
+
+    // the slowest candidate decides the prescaler - 12 bit times must fit into the
+    // 16-bit count, so that a burst can end without the counter wrapping around
+    for(i1=0, ulSlow=0xffffffffUL; candidates[i1]; i1++)
+    {
+        if(candidates[i1] < ulSlow)
+        {
+            ulSlow = candidates[i1];
+        }
+    }
+
+    ulBit = F_CPU / ulSlow * 12;
+
+    if(ulBit <= 60000UL)
+    {
+        bDiv = 1;
+        bClk = TC_CLKSEL_DIV1_gc;
+    }
+    else if(ulBit <= 120000UL)
+    {
+        bDiv = 2;
+        bClk = TC_CLKSEL_DIV2_gc;
+    }
+    else if(ulBit <= 240000UL)
+    {
+        bDiv = 4;
+        bClk = TC_CLKSEL_DIV4_gc;
+    }
+    else
+    {
+        bDiv = 8;
+        bClk = TC_CLKSEL_DIV8_gc;
+    }
+
+    wIdle = (uint16_t)((ulBit / bDiv) > 60000UL ? 60000UL : (ulBit / bDiv)); // end of a burst
+
+    // the PORT from the RX pin's PINnCTRL (at 10H + pin, ports are 20H apart)
+    pPort = (PORT_t *)((uint16_t)_ctrl_rx & ~0x1f);
+    bPin = ((uint16_t)_ctrl_rx & 0x1f) - 0x10;
+
+    _usart->CTRLB &= ~_BV(USART_RXEN_bp); // nothing goes into the RX buffer for now
+
+    // 'begin()' left the pin sensing both edges
+    SERIAL_AUTOBAUD_EVSYS_MUX = EVSYS_CHMUX_PORTA_PIN0_gc
+                              + (((uint16_t)pPort - (uint16_t)&PORTA) / sizeof(PORT_t)) * 8 + bPin;
+
+    SERIAL_AUTOBAUD_TIMER.CTRLFSET = TC_CMD_RESET_gc;
+    SERIAL_AUTOBAUD_TIMER.PER = 0xffff;
+    SERIAL_AUTOBAUD_TIMER.CTRLB = TC0_CCAEN_bm; // capture A
+    SERIAL_AUTOBAUD_TIMER.CTRLD = TC_EVACT_CAPT_gc | SERIAL_AUTOBAUD_EVSEL;
+    SERIAL_AUTOBAUD_TIMER.CTRLA = bClk;
+
+    bEdges = 0;
+    wMin = 0xffff;
+    bBest = 0;
+    ulStart = millis();
+
+    while(!ulRval && millis() - ulStart < timeoutMs)
+    {
+        if(SERIAL_AUTOBAUD_TIMER.INTFLAGS & TC0_CCAIF_bm)
+        {
+            wNow = SERIAL_AUTOBAUD_TIMER.CCA; // reading clears CCAIF, or moves CCABUF up
+
+            if(!bEdges)
+            {
+                wFirst = wNow; // the start bit
+            }
+            else
+            {
+                wDiff = wNow - wLast;
+
+                if(wDiff < wMin)
+                {
+                    wMin = wDiff;
+                }
+            }
+
+            wLast = wNow;
+            bEdges++;
+
+            if(bEdges < 2 || (bEdges < SERIAL_AUTOBAUD_EDGES
+                              && (uint16_t)(wNow - wFirst) < (unsigned long)wMin * SERIAL_AUTOBAUD_FRAME_BITS))
+            {
+                continue; // still in the first frame
+            }
+        }
+        else if(bEdges < 2
+                || ((uint16_t)(SERIAL_AUTOBAUD_TIMER.CNT - wLast) < wIdle
+                    && (uint16_t)(SERIAL_AUTOBAUD_TIMER.CNT - wFirst) < (unsigned long)wMin * SERIAL_AUTOBAUD_FRAME_BITS))
+        {
+            continue; // nothing yet, or still in the first frame
+        }
+
+        // closest candidate to the shortest pulse
+        ulBestErr = 0xffffffffUL;
+
+        for(i1=0; candidates[i1]; i1++)
+        {
+            ulBit = F_CPU / bDiv / candidates[i1];
+            ulErr = ulBit > wMin ? ulBit - wMin : wMin - ulBit;
+
+            if(ulErr < ulBestErr)
+            {
+                ulBestErr = ulErr;
+                bBest = i1;
+            }
+        }
+
+        ulBit = F_CPU / bDiv / candidates[bBest];
+
+        if(ulBestErr <= ulBit / SERIAL_AUTOBAUD_TOLERANCE)
+        {
+            ulRval = candidates[bBest];
+        }
+        else // no match (noise, or no single bits) - try the next burst
+        {
+            bEdges = 0;
+            wMin = 0xffff;
+        }
+    }
+
+    if(ulRval)
+    {
+        // the receiver starts on the next falling edge, so switch after the line was HIGH for a
+        // whole (longest) frame at the new rate.  Any edge starts the idle time over
+        ulBit = F_CPU / bDiv / ulRval * SERIAL_AUTOBAUD_IDLE_BITS;
+        wIdle = (uint16_t)(ulBit > 60000UL ? 60000UL : ulBit);
+        wLast = SERIAL_AUTOBAUD_TIMER.CNT;
+
+        while(millis() - ulStart < timeoutMs)
+        {
+            if(SERIAL_AUTOBAUD_TIMER.INTFLAGS & TC0_CCAIF_bm)
+            {
+                wLast = SERIAL_AUTOBAUD_TIMER.CCA;
+            }
+            else if((pPort->IN & _BV(bPin)) && (uint16_t)(SERIAL_AUTOBAUD_TIMER.CNT - wLast) >= wIdle)
+            {
+                break;
+            }
+        }
+    }
+
+    SERIAL_AUTOBAUD_TIMER.CTRLA = 0;
+    SERIAL_AUTOBAUD_TIMER.CTRLFSET = TC_CMD_RESET_gc;
+    SERIAL_AUTOBAUD_EVSYS_MUX = 0;
+
+    timerRelease(&SERIAL_AUTOBAUD_TIMER, TIMER_OWNER_AUTOBAUD);
+
+    if(!ulRval || !serialBaudCalc(ulRval, &sBaud))
+    {
+        _usart->CTRLB |= _BV(USART_RXEN_bp); // stays at 'candidates[0]'
+
+        return 0;
+    }
+
+    oldSREG = SREG;
+    cli();
+
+    _usart->BAUDCTRLA = (uint8_t)(sBaud.wSetting & 0xff);
+    _usart->BAUDCTRLB = (uint8_t)(sBaud.wSetting >> 8);
+    _usart->CTRLB = sBaud.bClk2x | _BV(USART_RXEN_bp) | _BV(USART_TXEN_bp);
+
+    _baud_actual = sBaud.ulActual;
+    _baud_ppm = sBaud.ulPPM;
+
+    _rx_buffer->head = _rx_buffer->tail;
+
+    SREG = oldSREG;
+
+    return ulRval;
+}
+
+void HardwareSerial::end()
+{
+    // wait for transmission of outgoing data
+    // TODO:  check for 'in an ISR' or stalled?
+
+    // interrupts are enabled
+    if(SREG & CPU_I_bm)
+    {
+        // if ints not disabled it's safe to
+        // do this - wait for tx_buffer to empty
+
+        while (_tx_buffer->head != _tx_buffer->tail) { }
+    }
+
+    if(_dma_tx >= 0 || _dma_rx >= 0)
+    {
+        enableDMA(0);
+    }
+
+    if(_half_duplex)
+    {
+        setHalfDuplex(false);
+    }
+
+    // disable RX, TX
+    _usart->CTRLB = 0;
+    // disable interrupts
+    _usart->CTRLA = 0;
+
+    // clear any received data
+    _rx_buffer->head = _rx_buffer->tail;
+
+    if(_rx_buffer->frame)
+    {
+        _rx_buffer->frame->bTail = _rx_buffer->frame->bHead;
+    }
+}
+
+int HardwareSerial::available(void)
+{
+    register int iRval;
+    // save old to restore interrupts as they were
+    register uint8_t oldSREG = SREG;
+
+    // clear interrupt flag to prevent
+    // inconsistency
+    cli();
+
+    if(_dma_rx >= 0)
+    {
+        _rx_buffer->head = dma_rx_pos(); // DMA writes into the buffer, 'head' follows it
+    }
+
+    iRval = (int)((serial_index_t)(_rx_buffer->head - _rx_buffer->tail) & _rx_buffer->mask);
+
+    // restore interrupt flag
+    SREG = oldSREG;
+
+    return iRval;
+}
+
+int HardwareSerial::peek(void)
+{
+  register int iRval;
+  register uint8_t oldSREG = SREG; // save old to restore interrupts as they were
+
+  cli(); // clear interrupt flag to prevent inconsistency
+
+  if(_dma_rx >= 0)
+  {
+    _rx_buffer->head = dma_rx_pos(); // DMA writes into the buffer, 'head' follows it
+  }
+
+  if (_rx_buffer->head == _rx_buffer->tail)
+  {
+    iRval = -1;
+  }
+  else
+  {
+    iRval = _rx_buffer->buffer[_rx_buffer->tail];
+  }
+
+  SREG = oldSREG; // restore interrupt flag
+
+  return iRval;
+}
+
+int HardwareSerial::read(void)
+{
+  register int iRval;
+  uint8_t oldSREG = SREG;
+
+  cli(); // clear interrupt flag for consistency
+
+  if(_dma_rx >= 0)
+  {
+    _rx_buffer->head = dma_rx_pos(); // DMA writes into the buffer, 'head' follows it
+  }
+
+  // if the head isn't ahead of the tail, we don't have any characters
+  if (_rx_buffer->head == _rx_buffer->tail)
+  {
+    iRval = -1;
+  }
+  else
+  {
+    iRval = (int)(_rx_buffer->buffer[_rx_buffer->tail]);
+
+    _rx_buffer->tail = (_rx_buffer->tail + 1) & _rx_buffer->mask;
+
+    // as I deplete the buffer, RTS goes LOW ('ok to send') again at the low watermark
+    if(_port < SERIAL_NUM_PORTS)
+    {
+      serial_rts_read(&serial_flow[_port], _rx_buffer);
+    }
+  }
+
+  SREG = oldSREG; // restore interrupt flag
+
+  return iRval;
+}
+
+void HardwareSerial::flush()
+{
+  // TODO:  force an 'sei' here?
+
+  if(_half_duplex) // the TXC ISR clears TXCIF, and then releases the line
+  {
+    while(_hd_tx)
+      ;
+
+    transmitting = false;
+
+    return;
+  }
+
+  // DATA is kept full while the buffer is not empty, so TXCIF triggers when EMPTY && SENT
+  while (transmitting && !(_usart->STATUS & _BV(USART_TXCIF_bp))) // TXCIF bit 6 indicates transmit complete
+    ;
+
+  transmitting = false;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+register serial_index_t i1;
+uint8_t oldSREG;
+
+
+  oldSREG = SREG; // get this FIRST
+  cli(); // in case I'm currently doing somethign ELSE that affects the _tx_buffer
+
+  i1 = (_tx_buffer->head + 1) & _tx_buffer->mask; // next head after this char
+
+  // If the output buffer is full, there's nothing for it other than to
+  // wait for the interrupt handler to empty it a bit
+
+  if (i1 == _tx_buffer->tail && _tx_policy != SERIAL_TX_BLOCK) // full, and I may not wait
+  {
+    // with DMA TX, the oldest bytes might be going out right now, so it drops the new one
+    if(_tx_policy == SERIAL_TX_DROP_NEW || _dma_tx >= 0)
+    {
+      _tx_dropped++;
+
+      SREG=oldSREG; // interrupts re-enabled
+
+      return 0; // short write count
+    }
+
+    // SERIAL_TX_DROP_OLDEST - the byte at 'tail' is not sent yet, so give up on it
+    _tx_buffer->tail = (_tx_buffer->tail + 1) & _tx_buffer->mask;
+    _tx_dropped++;
+  }
+
+  if (i1 == _tx_buffer->tail) // the buffer is still 'full'?
+  {
+    // if the interrupt flag is cleared in 'oldSREG' we must call the ISR directly
+    // otherwise we can set the int flag and wait for it
+
+    if((oldSREG & CPU_I_bm) && _dma_tx < 0) // interrupts were enabled
+    {
+      // make sure that the USART's RXC and DRE interupts are enabled
+      usart_dre_int(_usart, 1);
+    }
+
+    do
+    {
+      if(oldSREG & CPU_I_bm) // interrupts were enabled
+      {
+        sei(); // re-enable interrupts
+        __builtin_avr_delay_cycles((F_CPU / 2000000) + 1); // delay ~17 cycles, enough time to allow for an interrupt to happen
+      }
+      else if(_dma_tx >= 0) // the DMA interrupt can't run, so check for 'block complete' here
+      {
+        if(dmaChannel(_dma_tx)->CTRLB & (DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm))
+        {
+          dmaChannel(_dma_tx)->CTRLB |= DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm; // write 1 to clear
+          dma_tx_done();
+        }
+
+        if(_dma_rx < 0)
+        {
+          call_isr(_usart); // for RXC only, DRE is not enabled
+        }
+      }
+      else
+      {
+        call_isr(_usart); // this will block until there is a serial interrupt condition, but in an ISR-safe manner
+      }
+
+      i1 = (_tx_buffer->head + 1) & _tx_buffer->mask; // next head after this char
+
+      cli(); // do this regardless (smaller than another 'if' block, no harm if already clear)
+
+    } while (i1 == _tx_buffer->tail); // while the buffer is still 'full'
+  }
+
+  // if I didn't have to wait for buffer space, I'm already covered
+
+  _tx_buffer->buffer[_tx_buffer->head] = c;
+  _tx_buffer->head = i1; // I already incremented it earlier, assume nobody ELSE modifies this
+
+  if(_dma_tx >= 0) // DMA sends it, no DRE interrupt
+  {
+    dma_tx_start();
+
+    SREG=oldSREG; // interrupts re-enabled
+
+    return 1;
+  }
+
+  if(_half_duplex && !_hd_tx)
+  {
+    hd_tx_start();
+  }
+
+  // NOTE:  this messes with flow control.  it will still work, however
+//  _usart->CTRLA |= _BV(1) | _BV(0); // make sure I (re)enable the DRE interrupt (sect 19.14.3)
+  usart_dre_int(_usart, 1);
+
+  transmitting = true;
+//  sbi(_usart->STATUS,6);  // clear the TXCIF bit by writing a 1 to its location (sect 19.14.2)
+  _usart->STATUS = _BV(USART_TXCIF_bp); // other bits must be written as zero
+
+  SREG=oldSREG; // interrupts re-enabled
+
+  return 1;
+}
+
+// bulk write - copies as much as fits into the TX buffer, then publishes the new 'head' and
+// arms DRE (or DMA) ONCE.  The DRE ISR only reads from 'tail' up to 'head', so the copy itself
+// runs with interrupts as they were.  That needs the caller to be the only one that changes
+// 'head' and the free part of the buffer, which is NOT the case while the port is bridged (the
+// RXC ISR of the other port adds bytes with 'tx_isr()'), so then every byte goes through
+// 'write(uint8_t)'.  When the buffer is full, one byte goes through 'write(uint8_t)' as well,
+// since it knows how to wait.
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+size_t iRval = 0;
+unsigned int iLen, i1;
+serial_index_t iHead, iMask;
+uint8_t oldSREG;
+
+
+  if(bridging()) // 'head' changes in an ISR, so each byte has to be stored with interrupts off
+  {
+    while(size--)
+    {
+      iRval += write(*(buffer++));
+    }
+
+    return iRval;
+  }
+
+  iMask = _tx_buffer->mask;
+
+  while(size)
+  {
+    oldSREG = SREG;
+    cli();
+
+    iHead = _tx_buffer->head;
+    iLen = (serial_index_t)(_tx_buffer->tail - iHead - 1) & iMask; // free space
+
+    SREG = oldSREG;
+
+    if(!iLen) // full - wait for one byte the usual way
     {
-        bitTX = (SERIAL_4_TX_PIN_INDEX);
-        bitRX = (SERIAL_4_RX_PIN_INDEX);
-#ifdef SERIAL_4_REMAP
-        // NOTE: no remap for serial 4 through
-        // Serial 7
-#warning pin remap not supported for 'SERIAL_4'
-#endif // SERIAL_4_REMAP
+      if(_tx_policy == SERIAL_TX_DROP_NEW)
+      {
+        cli(); // don't even try, the rest is dropped
+
+        _tx_dropped += size;
+
+        SREG = oldSREG;
+
+        break;
+      }
+
+      iRval += write(*(buffer++)); // blocks, or drops the oldest byte
+
+      size--;
+
+      continue;
     }
-#endif // SERIAL_4_PORT_NAME
-#ifdef SERIAL_5_PORT_NAME
-    else if(_usart == &SERIAL_5_USART_NAME)
+
+    if(iLen > size)
     {
-        bitTX = (SERIAL_5_TX_PIN_INDEX);
-        bitRX = (SERIAL_5_RX_PIN_INDEX);
-#ifdef SERIAL_5_REMAP
-        // NOTE: no remap for serial 5
-        // through Serial 7
-#warning pin remap not supported for 'SERIAL_5'
-#endif // SERIAL_5_REMAP
+      iLen = size;
     }
-#endif // SERIAL_5_PORT_NAME
-#ifdef SERIAL_6_PORT_NAME
-    else if(_usart == &SERIAL_6_USART_NAME)
+
+    for(i1=iLen; i1 > 0; i1--)
     {
-        bitTX = (SERIAL_6_TX_PIN_INDEX);
-        bitRX = (SERIAL_6_RX_PIN_INDEX);
-#ifdef SERIAL_6_REMAP
-        // NOTE: no remap for serial 6
-        // through Serial 7
-#warning pin remap not supported for 'SERIAL_6'
-#endif // SERIAL_6_REMAP
+      _tx_buffer->buffer[iHead] = *(buffer++);
+      iHead = (iHead + 1) & iMask;
     }
-#endif // SERIAL_6_PORT_NAME
-#ifdef SERIAL_7_PORT_NAME
-    else if(_usart == &SERIAL_7_USART_NAME)
+
+    size -= iLen;
+    iRval += iLen;
+
+    cli();
+
+    _tx_buffer->head = iHead;
+
+    if(_dma_tx >= 0) // DMA sends it, no DRE interrupt
     {
-        bitTX = (SERIAL_7_TX_PIN_INDEX);
-        bitRX = (SERIAL_7_RX_PIN_INDEX);
-#ifdef SERIAL_7_REMAP
-        // NOTE: no remap for serial 7
-        // through Serial 7
-#warning pin remap not supported for 'SERIAL_7'
-#endif // SERIAL_7_REMAP
+      dma_tx_start();
     }
-#endif // SERIAL_7_PORT_NAME
     else
     {
-        // not valid
-        goto exit_point;
-    }
+      if(_half_duplex && !_hd_tx)
+      {
+        hd_tx_start();
+      }
 
-// USART setup - for existing ports only
-// (otherwise we just return)
+      usart_dre_int(_usart, 1);
 
-    if(_usart == &USARTD0
-#ifdef USARTD1
-        || _usart == &USARTD1
-#endif
-        )
-    {
-        reg = &PORTD_DIR;
-        out = &PORTD_OUT;
-        ctrlT = &PORTD_PIN0CTRL + bitTX;
-        ctrlR = &PORTD_PIN0CTRL + bitRX;
+      transmitting = true;
+      _usart->STATUS = _BV(USART_TXCIF_bp); // other bits must be written as zero
     }
-    else if(_usart == &USARTC0
-#ifdef USARTC1
-        || _usart == &USARTC1
-#endif
-        )
+
+    SREG = oldSREG;
+  }
+
+  return iRval;
+}
+
+int HardwareSerial::availableForWrite(void)
+{
+int iRval;
+uint8_t oldSREG = SREG;
+
+  cli();
+
+  iRval = (int)((serial_index_t)(_tx_buffer->tail - _tx_buffer->head - 1) & _tx_buffer->mask);
+
+  SREG = oldSREG;
+
+  return iRval;
+}
+
+void HardwareSerial::setRxHook(serialRxHook pHook, void *pCtx)
+{
+uint8_t oldSREG = SREG;
+
+  if(_port >= SERIAL_NUM_PORTS)
+  {
+    return;
+  }
+
+  cli(); // the ISR must never see a hook with the wrong context
+
+  serial_rx_hook[_port].pHook = pHook;
+  serial_rx_hook[_port].pCtx = pCtx;
+
+  SREG = oldSREG;
+}
+
+// INVEN in PINnCTRL inverts the pin in the port logic (A manual sect 13.13.15), so the USART
+// sees normal levels.  'begin()' clears it, so call this after 'begin()'
+void HardwareSerial::setInverted(bool bRX, bool bTX)
+{
+  if(!_ctrl_rx || !_ctrl_tx)
+  {
+    return; // 'begin()' wasn't called
+  }
+
+  if(bRX)
+  {
+    *_ctrl_rx |= PORT_INVEN_bm;
+  }
+  else
+  {
+    *_ctrl_rx &= ~PORT_INVEN_bm;
+  }
+
+  if(bTX)
+  {
+    *_ctrl_tx |= PORT_INVEN_bm;
+  }
+  else
+  {
+    *_ctrl_tx &= ~PORT_INVEN_bm;
+  }
+}
+
+// RTS/CTS on any pin, at run time.  RTS is an output, HIGH tells the other side to stop sending.
+// It goes HIGH when the RX buffer holds 'highWater' bytes, and LOW again once reading got it
+// down to 'lowWater'.  The gap between them keeps RTS from toggling on every byte, and the room
+// above 'highWater' is for the bytes the other side sends before it sees RTS.  CTS is an input
+// (with pull-up), while it is HIGH the DRE ISR stops sending.  It is polled by the idle timer
+// (appx 1ms) to start again, the CTS pins from 'pins_arduino.h' also have a pin change interrupt.
+void HardwareSerial::flow_set(PORT_t *pRTS, uint8_t bRTS, PORT_t *pCTS, uint8_t bCTS,
+                              unsigned int iHigh, unsigned int iLow)
+{
+SERIAL_FLOW *pF;
+uint8_t oldSREG;
+
+  if(_port >= SERIAL_NUM_PORTS)
+  {
+    return;
+  }
+
+  pF = &serial_flow[_port];
+
+  // default - stop with 3 bytes of room left, like before, and start again at half of that
+  if(!iHigh || iHigh > _rx_buffer->mask)
+  {
+    iHigh = _rx_buffer->mask > 8 ? _rx_buffer->mask - 3 : _rx_buffer->mask;
+  }
+
+  if(!iLow || iLow >= iHigh)
+  {
+    iLow = iHigh / 2;
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  pF->pRTS = pRTS;
+  pF->bRTS = bRTS;
+  pF->pCTS = pCTS;
+  pF->bCTS = bCTS;
+  pF->wHigh = (serial_index_t)iHigh;
+  pF->wLow = (serial_index_t)iLow;
+  pF->pUSART = _usart;
+  pF->pTX = _tx_buffer;
+  pF->bWait = 0;
+
+  if(pRTS)
+  {
+    if(serial_rx_used(_rx_buffer) >= pF->wHigh)
     {
-        reg = &PORTC_DIR;
-        out = &PORTC_OUT;
-        ctrlT = &PORTC_PIN0CTRL + bitTX;
-        ctrlR = &PORTC_PIN0CTRL + bitRX;
+      pRTS->OUTSET = bRTS;
     }
-#ifdef USARTE0
-    else if(_usart == &USARTE0
-#ifdef USARTE1
-        || _usart == &USARTE1
-#endif
-        )
+    else
     {
-        reg = &PORTE_DIR;
-        out = &PORTE_OUT;
-        ctrlT = &PORTE_PIN0CTRL + bitTX;
-        ctrlR = &PORTE_PIN0CTRL + bitRX;
+      pRTS->OUTCLR = bRTS;
     }
-#endif
-#ifdef USARTF0
-    else if(_usart == &USARTF0
-#ifdef USARTF1
-        || _usart == &USARTF1
-#endif
-        )
+
+    pRTS->DIRSET = bRTS;
+  }
+
+  if(pCTS)
+  {
+    pCTS->DIRCLR = bCTS;
+    *(&(pCTS->PIN0CTRL) + pinBitValueToIndex(bCTS)) = PORT_OPC_PULLUP_gc; // sense both edges
+  }
+
+  // in case the DRE ISR stopped for CTS, it checks again
+  if(_dma_tx < 0 && _tx_buffer->head != _tx_buffer->tail)
+  {
+    usart_dre_int(_usart, 1);
+  }
+
+  serial_tick_update();
+
+  SREG = oldSREG;
+}
+
+bool HardwareSerial::setFlowControl(int rtsPin, int ctsPin, unsigned int highWater, unsigned int lowWater)
+{
+PORT_t *pRTS = NULL, *pCTS = NULL;
+uint8_t bRTS = 0, bCTS = 0, port;
+
+  if(!_tx_port || _dma_tx >= 0 || _dma_rx >= 0) // no 'begin()', or DMA
+  {
+    return false;
+  }
+
+  // -1 is 'none', anything else must be a pin.  The pin tables are only valid below NUM_DIGITAL_PINS
+  if((rtsPin != -1 && (rtsPin < 0 || rtsPin >= NUM_DIGITAL_PINS))
+     || (ctsPin != -1 && (ctsPin < 0 || ctsPin >= NUM_DIGITAL_PINS)))
+  {
+    return false;
+  }
+
+  if(rtsPin >= 0)
+  {
+    port = digitalPinToPort(rtsPin);
+
+    if(port == NOT_A_PIN)
     {
-        reg = &PORTF_DIR;
-        out = &PORTF_OUT;
-        ctrlT = &PORTF_PIN0CTRL + bitTX;
-        ctrlR = &PORTF_PIN0CTRL + bitRX;
+      return false;
     }
-#endif
-    else
+
+    pRTS = (PORT_t *)portModeRegister(port);
+    bRTS = digitalPinToBitMask(rtsPin);
+  }
+
+  if(ctsPin >= 0)
+  {
+    port = digitalPinToPort(ctsPin);
+
+    if(port == NOT_A_PIN)
     {
-         // not valid
-        goto exit_point;
+      return false;
     }
 
-    // port config, transmit bit
-    bit = 1 << bitTX;
-    *ctrlT = 0; // trigger on BOTH, totem, no pullup
-    *out |= bit; // set to 'HIGH'
-    *reg |= bit; // set as output
+    pCTS = (PORT_t *)portModeRegister(port);
+    bCTS = digitalPinToBitMask(ctsPin);
+  }
+
+  flow_set(pRTS, bRTS, pCTS, bCTS, highWater, lowWater);
+
+  return true;
+}
+
+// Half duplex - the XMEGA A USART has no loopback or one-wire mode, so TX and RX are tied together
+// on the board and the TX pin is released (input with pull-up, or pull-down when inverted) while
+// not sending.  'write()' turns the receiver off and drives the line, the TXC interrupt at the end
+// of the last stop bit releases it and turns the receiver back on.  Turning RXEN off also flushes
+// the receiver (A manual sect 19.14.4), so the echo of my own bytes never shows up.
+bool HardwareSerial::setHalfDuplex(bool bEnable)
+{
+uint8_t oldSREG;
+
+  if(!_tx_port || _port >= SERIAL_NUM_PORTS) // 'begin()' wasn't called
+  {
+    return false;
+  }
+
+  if(bEnable && (!(serial_txc_ports & _BV(_port)) || _dma_tx >= 0 || _dma_rx >= 0))
+  {
+    return false; // no TXC interrupt for this port, or DMA is on
+  }
+
+  flush(); // the pin must not change in the middle of a byte
+
+  oldSREG = SREG;
+  cli();
+
+  if(bEnable)
+  {
+    *_ctrl_tx = (*_ctrl_tx & PORT_INVEN_bm) ? (PORT_INVEN_bm | PORT_OPC_PULLDOWN_gc) : PORT_OPC_PULLUP_gc;
+    _tx_port->DIRCLR = _tx_bit; // released until the next 'write()'
+
+    _hd_tx = 0;
+    _half_duplex = 1;
+    serial_half_duplex[_port] = this;
+
+    _usart->STATUS = _BV(USART_TXCIF_bp); // no old TXC
+    _usart->CTRLA |= _BV(USART_TXCINTLVL1_bp) | _BV(USART_TXCINTLVL0_bp); // same level as DRE
+  }
+  else
+  {
+    _usart->CTRLA &= ~(_BV(USART_TXCINTLVL1_bp) | _BV(USART_TXCINTLVL0_bp));
+
+    serial_half_duplex[_port] = NULL;
+    _half_duplex = 0;
+    _hd_tx = 0;
+
+    *_ctrl_tx &= PORT_INVEN_bm; // totem, no pull
+    _tx_port->DIRSET = _tx_bit;
+    _usart->CTRLB |= _BV(USART_RXEN_bp);
+  }
+
+  SREG = oldSREG;
+
+  return true;
+}
+
+// called with interrupts disabled, before the first byte goes into DATA
+void HardwareSerial::hd_tx_start(void)
+{
+  _usart->CTRLB &= ~_BV(USART_RXEN_bp); // no echo
+  _tx_port->DIRSET = _tx_bit; // OUT is HIGH (idle) since 'begin()', so no glitch
+
+  _hd_tx = 1;
+}
+
+void HardwareSerial::hd_tx_done(void)
+{
+  if(_tx_buffer->head != _tx_buffer->tail) // 'write()' added more - DRE sends it, then TXC comes again
+  {
+    return;
+  }
+
+  _tx_port->DIRCLR = _tx_bit; // release the line
+  _usart->CTRLB |= _BV(USART_RXEN_bp); // and listen
+
+  _hd_tx = 0;
+  transmitting = false;
+}
+
+int HardwareSerial::read9(void)
+{
+int iRval;
+serial_index_t iTail;
+uint8_t oldSREG = SREG;
+
+  cli();
+
+  iTail = _rx_buffer->tail;
+  iRval = read();
+
+  if(iRval >= 0 && _rx_buffer->bit9 && (_rx_buffer->bit9[iTail >> 3] & _BV(iTail & 7)))
+  {
+    iRval |= 0x100;
+  }
+
+  SREG = oldSREG;
+
+  return iRval;
+}
+
+// TXB8 in CTRLB is not buffered like DATA, so the byte is sent on its own, after everything
+// else has gone out.  Good enough for address frames, which are rare
+size_t HardwareSerial::write9(uint16_t c)
+{
+uint8_t oldSREG;
+
+  flush();
 
-    // port config, receive bit
-    bit = 1 << bitRX;
-    *ctrlR = 0; // triger on BOTH, no pullup
-    *out &= ~bit; // off
-    *reg &= ~bit; // set as input
+  oldSREG = SREG;
+  cli();
 
-    // section 19.4.4
-    // enable clock 2x when set
-    // (everything else disabled)
-    _usart->CTRLB = use_u2x;
+  if(_half_duplex && !_hd_tx) // RS-485 driver on, the TXC interrupt turns it off again
+  {
+    hd_tx_start();
+  }
 
+  if(c & 0x100)
+  {
+    _usart->CTRLB |= USART_TXB8_bm;
+  }
+  else
+  {
+    _usart->CTRLB &= ~USART_TXB8_bm;
+  }
 
-    // section 19.14.5 - USART mode, parity,
-    // bits
-    // CMODE 7:6   00 [async]
-    // PMODE 5:4   00=none  10=even 11=odd
-    // SBMODE 3    0=1 stop  1=2 stop
-    // CHSIZE 2:0  000=5 bit 001=6 bit  010=7 bit  011=8 bit  111=9 bit
-    _usart->CTRLC = config & ~(_BV(USART_CMODE1_bp)|_BV(USART_CMODE0_bp)); // make sure bits 6 and 7 are cleared
-#ifdef USARTD0_CTRLD
-    // E5 has this register, must assign to zero
-    _usart->CTRLD = 0;
-#endif
+  _usart->STATUS = _BV(USART_TXCIF_bp); // for 'flush()'
+  _usart->DATA = (uint8_t)c;
 
-    // assign the baud_setting, a.k.a. ubbr
-    // (USART Baud Rate Register)
-    _usart->BAUDCTRLA = (uint8_t)(baud_setting & 0xff);
-    _usart->BAUDCTRLB = (uint8_t)(baud_setting >> 8);
+  transmitting = true;
 
-    // section 19.4.4
-    // enable RX, enable TX.
-    // Bit 2 will be 1 or 0 based on
-    // clock 2x/1x.  multi-processor disabled.
-    // bit 9 = 0
-    _usart->CTRLB = use_u2x | _BV(USART_RXEN_bp) | _BV(USART_TXEN_bp);
+  SREG = oldSREG;
 
-    // priority 3 for RX interrupts.
-    // DRE and TX interrupts OFF (for now).
-    _usart->CTRLA = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp);
+  while(!(_usart->STATUS & _BV(USART_DREIF_bp))) // in the shift register, with its 9th bit
+    ;
 
-exit_point:
-    // restore interrupt flag
-    // (now that I'm done assigning things)
-    SREG = oldSREG;
+  oldSREG = SREG;
+  cli();
+
+  _usart->CTRLB &= ~USART_TXB8_bm; // data frames from 'write()'
+
+  SREG = oldSREG;
+
+  return 1;
 }
 
-void HardwareSerial::end()
+static bool serial_multidrop_hook(void *pCtx, uint8_t c, uint8_t stat)
 {
-    // wait for transmission of outgoing data
-    // TODO:  check for 'in an ISR' or stalled?
+  return ((HardwareSerial *)pCtx)->md_rx(c, stat);
+}
 
-    // interrupts are enabled
-    if(SREG & CPU_I_bm)
-    {
-        // if ints not disabled it's safe to
-        // do this - wait for tx_buffer to empty
+// Multi-processor communication mode (A manual sect 19.13).  While MPCM is set, the receiver
+// ignores every frame with the 9th bit cleared, so data for other nodes never interrupts.  An
+// address frame (9th bit set) always does, and this decides if the data after it is for me.
+bool HardwareSerial::md_rx(uint8_t c, uint8_t stat)
+{
+  if(!(stat & USART_RXB8_bm)) // data - MPCM is off, so it's for me
+  {
+    return false;
+  }
 
-        while (_tx_buffer->head != _tx_buffer->tail) { }
-    }
+  if(c == _md_addr || c == SERIAL_MULTIDROP_BROADCAST)
+  {
+    _usart->CTRLB &= ~USART_MPCM_bm; // receive the data that follows
 
-    // disable RX, TX
-    _usart->CTRLB = 0;
-    // disable interrupts
-    _usart->CTRLA = 0;
+    return false; // the address goes into the RX buffer too, 'read9()' has bit 8 set for it
+  }
 
-    // clear any received data
-    _rx_buffer->head = _rx_buffer->tail;
+  _usart->CTRLB |= USART_MPCM_bm; // somebody else's
+
+  return true;
 }
 
-int HardwareSerial::available(void)
+void HardwareSerial::beginMultidrop(unsigned long baud, uint8_t address)
 {
-    register int iRval;
-    // save old to restore interrupts as they were
-    register uint8_t oldSREG = SREG;
+uint8_t oldSREG;
 
-    // clear interrupt flag to prevent
-    // inconsistency
-    cli();
+  if(_dma_rx >= 0) // MPCM needs the RXC interrupt and bit 8 in the RX buffer
+  {
+    return;
+  }
 
-    iRval = (int)((unsigned int)(SERIAL_BUFFER_SIZE + (unsigned int)_rx_buffer->head - (unsigned int)_rx_buffer->tail)
-                % SERIAL_BUFFER_SIZE);
+  begin(baud, SERIAL_9N1);
 
-    // restore interrupt flag
-    SREG = oldSREG;
+  if(!_baud_actual || _port >= SERIAL_NUM_PORTS)
+  {
+    return;
+  }
 
-    return iRval;
+  _md_addr = address;
+  _multidrop = 1;
+
+  setRxHook(serial_multidrop_hook, this);
+
+  oldSREG = SREG;
+  cli();
+
+  _usart->CTRLB |= USART_MPCM_bm; // wait for an address frame
+
+  SREG = oldSREG;
 }
 
-int HardwareSerial::peek(void)
+static bool serial_receive_hook(void *pCtx, uint8_t c, uint8_t stat)
 {
-  register int iRval;
-  register uint8_t oldSREG = SREG; // save old to restore interrupts as they were
+  return ((HardwareSerial *)pCtx)->rx_direct(c, stat);
+}
 
-  cli(); // clear interrupt flag to prevent inconsistency
+// Direct receive - the RXC ISR already read one byte.  The receive buffer in the USART is 2 deep
+// (A manual sect 19.3.3), so more can be waiting, and all of them go to the callback in one call
+// for as long as RXCIF stays set.  Nothing goes into the RX buffer, and 'serialEvent()' isn't called.
+bool HardwareSerial::rx_direct(uint8_t c, uint8_t stat)
+{
+uint8_t buf[SERIAL_RX_BURST_MAX], bLen = 0;
 
-  if (_rx_buffer->head == _rx_buffer->tail)
-  {
-    iRval = -1;
-  }
-  else
+  for(;;)
   {
-    iRval = _rx_buffer->buffer[_rx_buffer->tail];
+    serial_count_errors(stat, _stats);
+
+    buf[bLen++] = c;
+
+    if(bLen >= SERIAL_RX_BURST_MAX)
+    {
+      break;
+    }
+
+    stat = _usart->STATUS;
+
+    if(!(stat & _BV(USART_RXCIF_bp)))
+    {
+      break;
+    }
+
+    c = _usart->DATA;
   }
 
-  SREG = oldSREG; // restore interrupt flag
+  _rx_cb(_rx_cb_ctx, buf, bLen);
 
-  return iRval;
+  return true;
 }
 
-int HardwareSerial::read(void)
+bool HardwareSerial::onReceive(serialReceiveCallback pCallback, void *pCtx)
 {
-  register int iRval;
-  uint8_t oldSREG = SREG;
+  if(_port >= SERIAL_NUM_PORTS)
+  {
+    return false;
+  }
 
-  cli(); // clear interrupt flag for consistency
+  if(!pCallback)
+  {
+    if(serial_rx_hook[_port].pHook == serial_receive_hook)
+    {
+      setRxHook(NULL, NULL); // back to the RX buffer
+    }
 
-  // each time I'm ready to read a byte, double-check that the RTS (when enabled)
-  // needs to be set to a 0 value [which enables things to be sent to me].  As
-  // I deplete the buffer, RTS will enable, and as I fill it, RTS will disable.
+    _rx_cb = NULL;
 
-  // This section is the 'deplete' part.  So I'll set RTS to 'LOW' which is 'ok to send'
-  // if the buffer is _NOT_ too full (the set_not_rts() function determines that)
+    return true;
+  }
 
-#ifdef SERIAL_0_RTS_ENABLED
-  if(_rx_buffer == &rx_buffer && // it's serial #0
-     !set_not_rts(&rx_buffer))   // do I need to turn off RTS ?
+  if(_dma_rx >= 0 || _multidrop || bridging()) // they need the RXC ISR, or the RX hook
   {
-    SERIAL_0_RTS_PORT->OUT &= ~SERIAL_0_RTS_PIN; // set to '0'
-    SERIAL_0_RTS_PORT->DIR |= SERIAL_0_RTS_PIN; // make sure it's an output
+    return false;
   }
-#endif // SERIAL_0_RTS_ENABLED
 
-#ifdef SERIAL_1_RTS_ENABLED
-  if(_rx_buffer == &rx_buffer2 && // it's serial #1
-     !set_not_rts(&rx_buffer2))   // do I need to turn off RTS ?
+  // the callback gets 8 bits per byte, so RXB8 would be lost - use 'read9()' for 9-bit frames
+  if((_usart->CTRLC & USART_CHSIZE_gm) == USART_CHSIZE_9BIT_gc)
   {
-    SERIAL_1_RTS_PORT->OUT &= ~SERIAL_1_RTS_PIN; // set to '0'
-    SERIAL_1_RTS_PORT->DIR |= SERIAL_1_RTS_PIN; // make sure it's an output
+    return false;
+  }
+
+  // somebody else's hook ('setRxHook()', e.g. RCSerial or 'FrameDecoder::rxHook')
+  if(serial_rx_hook[_port].pHook && serial_rx_hook[_port].pHook != serial_receive_hook)
+  {
+    return false;
   }
-#endif // SERIAL_1_RTS_ENABLED
 
-  // back to regular serial I/O handling
+  setRxHook(NULL, NULL); // the ISR must never see a new hook with the old callback
 
-  // if the head isn't ahead of the tail, we don't have any characters
-  if (_rx_buffer->head == _rx_buffer->tail)
+  _rx_cb = pCallback;
+  _rx_cb_ctx = pCtx;
+
+  setRxHook(serial_receive_hook, this);
+
+  return true;
+}
+
+bool HardwareSerial::setFrameGap(unsigned long gapUs)
+{
+SERIAL_FRAME *pF = _rx_buffer->frame;
+uint8_t oldSREG;
+
+  if(gapUs && _dma_rx >= 0) // no RXC interrupt
   {
-    iRval = -1;
+    return false;
   }
-  else
+
+  if(!gapUs)
   {
-    iRval = (int)(_rx_buffer->buffer[_rx_buffer->tail]);
+    if(pF)
+    {
+      oldSREG = SREG;
+      cli();
+
+      _rx_buffer->frame = NULL;
+
+      SREG = oldSREG;
+
+      free(pF);
+    }
 
-    _rx_buffer->tail = (unsigned int)(_rx_buffer->tail + 1) % SERIAL_BUFFER_SIZE;
+    return true;
   }
 
-  SREG = oldSREG; // restore interrupt flag
+  if(!pF)
+  {
+    pF = (SERIAL_FRAME *)malloc(sizeof(SERIAL_FRAME));
 
-  return iRval;
-}
+    if(!pF)
+    {
+      return false;
+    }
 
-void HardwareSerial::flush()
-{
-  // TODO:  force an 'sei' here?
+    pF->bHead = pF->bTail = 0;
+  }
 
-  // DATA is kept full while the buffer is not empty, so TXCIF triggers when EMPTY && SENT
-  while (transmitting && !(_usart->STATUS & _BV(USART_TXCIF_bp))) // TXCIF bit 6 indicates transmit complete
-    ;
+  oldSREG = SREG;
+  cli();
 
-  transmitting = false;
+  pF->ulGap = gapUs;
+  pF->ulLast = micros(); // the first byte starts a frame anyway, since the queue is empty
+
+  if(!_rx_buffer->frame) // anything already in the buffer is one frame
+  {
+    if(_rx_buffer->head != _rx_buffer->tail)
+    {
+      pF->pos[0] = _rx_buffer->tail;
+      pF->time[0] = pF->ulLast;
+      pF->bHead = 1;
+    }
+
+    _rx_buffer->frame = pF;
+  }
+
+  SREG = oldSREG;
+
+  return true;
 }
 
-size_t HardwareSerial::write(uint8_t c)
+int HardwareSerial::readFrame(uint8_t *buf, unsigned int maxLen, unsigned long *pTime)
 {
-register unsigned int i1;
-uint8_t oldSREG;
+SERIAL_FRAME *pF = _rx_buffer->frame;
+serial_index_t iPos, iEnd;
+uint8_t bNext, oldSREG;
+int iRval = 0;
 
+  if(!pF)
+  {
+    return -1;
+  }
 
-  oldSREG = SREG; // get this FIRST
-  cli(); // in case I'm currently doing somethign ELSE that affects the _tx_buffer
+  oldSREG = SREG;
+  cli();
 
-  i1 = (unsigned int)((_tx_buffer->head + 1) % SERIAL_BUFFER_SIZE); // next head after this char
+  if(pF->bHead == pF->bTail)
+  {
+    SREG = oldSREG;
 
-  // If the output buffer is full, there's nothing for it other than to
-  // wait for the interrupt handler to empty it a bit
+    return -1; // nothing
+  }
 
-  if (i1 == _tx_buffer->tail) // the buffer is still 'full'?
+  bNext = (pF->bTail + 1) & (SERIAL_FRAME_MAX - 1);
+
+  if(bNext != pF->bHead) // the next frame started, so this one ends there
   {
-    // if the interrupt flag is cleared in 'oldSREG' we must call the ISR directly
-    // otherwise we can set the int flag and wait for it
+    iEnd = pF->pos[bNext];
+  }
+  else if(micros() - pF->ulLast > pF->ulGap) // the line is idle, so it ends at 'head'
+  {
+    iEnd = _rx_buffer->head;
+  }
+  else
+  {
+    SREG = oldSREG;
+
+    return -1; // still arriving
+  }
+
+  if(pTime)
+  {
+    *pTime = pF->time[pF->bTail];
+  }
+
+  pF->bTail = bNext;
+
+  SREG = oldSREG;
+
+  // the ISR only writes at 'head', which is past 'iEnd'.  Starts at 'tail' in case
+  // somebody used 'read()' in the middle of the frame
+  iPos = _rx_buffer->tail;
 
-    if(oldSREG & CPU_I_bm) // interrupts were enabled
+  while(iPos != iEnd)
+  {
+    if((unsigned int)iRval < maxLen)
     {
-      // make sure that the USART's RXC and DRE interupts are enabled
-      _usart->CTRLA = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp)
-                    | _BV(USART_DREINTLVL1_bp) | _BV(USART_DREINTLVL0_bp); // set int bits for rx and dre (sect 19.14.3)
+      buf[iRval++] = _rx_buffer->buffer[iPos];
     }
 
-    do
-    {
-      if(oldSREG & CPU_I_bm) // interrupts were enabled
-      {
-        sei(); // re-enable interrupts
-        __builtin_avr_delay_cycles((F_CPU / 2000000) + 1); // delay ~17 cycles, enough time to allow for an interrupt to happen
-      }
-      else
-      {
-        call_isr(_usart); // this will block until there is a serial interrupt condition, but in an ISR-safe manner
-      }
+    iPos = (iPos + 1) & _rx_buffer->mask; // anything past 'maxLen' is dropped
+  }
 
-      i1 = (unsigned int)((_tx_buffer->head + 1) % SERIAL_BUFFER_SIZE); // next head after this char
+  oldSREG = SREG;
+  cli();
 
-      cli(); // do this regardless (smaller than another 'if' block, no harm if already clear)
+  _rx_buffer->tail = iEnd;
 
-    } while (i1 == _tx_buffer->tail); // while the buffer is still 'full'
+  if(_port < SERIAL_NUM_PORTS)
+  {
+    serial_rts_read(&serial_flow[_port], _rx_buffer);
   }
 
-  // if I didn't have to wait for buffer space, I'm already covered
+  SREG = oldSREG;
 
-  _tx_buffer->buffer[_tx_buffer->head] = c;
-  _tx_buffer->head = i1; // I already incremented it earlier, assume nobody ELSE modifies this
+  return iRval;
+}
 
-  // NOTE:  this messes with flow control.  it will still work, however
-//  _usart->CTRLA |= _BV(1) | _BV(0); // make sure I (re)enable the DRE interrupt (sect 19.14.3)
-  _usart->CTRLA = _BV(USART_RXCINTLVL1_bp) | _BV(USART_RXCINTLVL0_bp)
-                | _BV(USART_DREINTLVL1_bp) | _BV(USART_DREINTLVL0_bp); // set int bits for rx and dre (sect 19.14.3)
+SERIAL_STATS HardwareSerial::stats(bool bClear)
+{
+SERIAL_STATS rval;
+uint8_t oldSREG = SREG;
 
-  transmitting = true;
-//  sbi(_usart->STATUS,6);  // clear the TXCIF bit by writing a 1 to its location (sect 19.14.2)
-  _usart->STATUS = _BV(USART_TXCIF_bp); // other bits must be written as zero
+  cli(); // the RXC ISR changes these
 
-  SREG=oldSREG; // interrupts re-enabled
+  rval = *_stats;
 
-  return 1;
+  if(bClear)
+  {
+    memset(_stats, 0, sizeof(*_stats));
+  }
+
+  SREG = oldSREG;
+
+  return rval;
+}
+
+unsigned long HardwareSerial::txDropped(bool bClear)
+{
+unsigned long ulRval;
+uint8_t oldSREG = SREG;
+
+  cli(); // the count is 32 bits, so read it atomically
+
+  ulRval = _tx_dropped;
+
+  if(bClear)
+  {
+    _tx_dropped = 0;
+  }
+
+  SREG = oldSREG;
+
+  return ulRval;
 }
 
 HardwareSerial::operator bool()
@@ -1666,35 +4071,35 @@ HardwareSerial::operator bool()
 //        and 'Serial2' will always be the '2nd' serial port ('Serial1' *could* become an alias)
 
 #ifdef USBCON
-HardwareSerial Serial1(&rx_buffer, &tx_buffer, (uint16_t)&(SERIAL_0_USART_NAME)); // name changes to 'Serial1' when USB present
+HardwareSerial Serial1(&rx_buffer, &tx_buffer, &rx_stats, (uint16_t)&(SERIAL_0_USART_NAME)); // name changes to 'Serial1' when USB present
 #else // normal
-HardwareSerial Serial(&rx_buffer, &tx_buffer, (uint16_t)&(SERIAL_0_USART_NAME));
+HardwareSerial Serial(&rx_buffer, &tx_buffer, &rx_stats, (uint16_t)&(SERIAL_0_USART_NAME));
 #endif // USBCON or normal
 
-HardwareSerial Serial2(&rx_buffer2, &tx_buffer2, (uint16_t)&(SERIAL_1_USART_NAME));
+HardwareSerial Serial2(&rx_buffer2, &tx_buffer2, &rx_stats2, (uint16_t)&(SERIAL_1_USART_NAME));
 
 #ifdef SERIAL_2_PORT_NAME  /* note these names are off by 1 with the 'Serial_N_' objects */
-HardwareSerial Serial3(&rx_buffer3, &tx_buffer3, (uint16_t)&(SERIAL_2_USART_NAME));
+HardwareSerial Serial3(&rx_buffer3, &tx_buffer3, &rx_stats3, (uint16_t)&(SERIAL_2_USART_NAME));
 #endif // SERIAL_2_PORT_NAME
 
 #ifdef SERIAL_3_PORT_NAME
-HardwareSerial Serial4(&rx_buffer4, &tx_buffer4, (uint16_t)&(SERIAL_3_USART_NAME));
+HardwareSerial Serial4(&rx_buffer4, &tx_buffer4, &rx_stats4, (uint16_t)&(SERIAL_3_USART_NAME));
 #endif // SERIAL_3_PORT_NAME
 
 #ifdef SERIAL_4_PORT_NAME
-HardwareSerial Serial5(&rx_buffer5, &tx_buffer5, (uint16_t)&(SERIAL_3_USART_NAME));
+HardwareSerial Serial5(&rx_buffer5, &tx_buffer5, &rx_stats5, (uint16_t)&(SERIAL_4_USART_NAME));
 #endif // SERIAL_4_PORT_NAME
 
 #ifdef SERIAL_5_PORT_NAME
-HardwareSerial Serial6(&rx_buffer6, &tx_buffer6, (uint16_t)&(SERIAL_3_USART_NAME));
+HardwareSerial Serial6(&rx_buffer6, &tx_buffer6, &rx_stats6, (uint16_t)&(SERIAL_5_USART_NAME));
 #endif // SERIAL_5_PORT_NAME
 
 #ifdef SERIAL_6_PORT_NAME
-HardwareSerial Serial7(&rx_buffer7, &tx_buffer7, (uint16_t)&(SERIAL_3_USART_NAME));
+HardwareSerial Serial7(&rx_buffer7, &tx_buffer7, &rx_stats7, (uint16_t)&(SERIAL_6_USART_NAME));
 #endif // SERIAL_6_PORT_NAME
 
 #ifdef SERIAL_7_PORT_NAME
-HardwareSerial Serial8(&rx_buffer8, &tx_buffer8, (uint16_t)&(SERIAL_3_USART_NAME));
+HardwareSerial Serial8(&rx_buffer8, &tx_buffer8, &rx_stats8, (uint16_t)&(SERIAL_7_USART_NAME));
 #endif // SERIAL_7_PORT_NAME
 
 
@@ -35,6 +35,36 @@
 
 struct ring_buffer;
 
+// receive error counters, see 'HardwareSerial::stats()'
+typedef struct _SERIAL_STATS_
+{
+  uint16_t overrun;  // BUFOVF - the USART lost bytes because the RXC ISR was late
+  uint16_t framing;  // FERR - bad stop bit (wrong baud rate, noise, wiring)
+  uint16_t parity;   // PERR - parity error
+  uint16_t dropped;  // the RX buffer was full, so the byte was thrown away
+  unsigned int peak; // highest number of bytes in the RX buffer
+} SERIAL_STATS;
+
+// RX hook - called from the RXC ISR for every byte, with the USART STATUS that goes with it.
+// return 'true' if the byte was used, 'false' to put it into the RX buffer as usual
+typedef bool (*serialRxHook)(void *pCtx, uint8_t c, uint8_t stat);
+
+// receive callback - see 'HardwareSerial::onReceive()'.  Called from the RXC ISR with the bytes
+// the USART had (usually 1, more when the ISR was late).  'pData' is only valid during the call
+typedef void (*serialReceiveCallback)(void *pCtx, const uint8_t *pData, uint8_t bLen);
+
+// result of 'serialBaudCalc()'
+typedef struct _SERIAL_BAUD_
+{
+  uint16_t wSetting;       // BAUDCTRLB:BAUDCTRLA - BSCALE in bits 15:12, BSEL in bits 11:0
+  uint8_t bClk2x;          // _BV(USART_CLK2X_bp) or 0, for CTRLB
+  unsigned long ulActual;  // the baud rate you really get
+  unsigned long ulPPM;     // error, in parts per million
+} SERIAL_BAUD;
+
+// best BSEL/BSCALE/CLK2X for 'baud' at F_CPU.  returns 'false' if it's out of range
+bool serialBaudCalc(unsigned long baud, SERIAL_BAUD *pBaud);
+
 class HardwareSerial : public Stream
 {
     // NEVER 'private'
@@ -46,13 +76,50 @@ class HardwareSerial : public Stream
         ring_buffer *_rx_buffer;
         ring_buffer *_tx_buffer;
         volatile USART_t *_usart;
+        SERIAL_STATS *_stats;
+        uint8_t _port;                     // 0 for 'Serial', 1 for 'Serial2', etc.
+        volatile uint8_t *_ctrl_rx;        // PINnCTRL for the RX pin, set by 'begin()'
+        volatile uint8_t *_ctrl_tx;        // PINnCTRL for the TX pin
+        PORT_t *_tx_port;                  // port and bit of the TX pin, for half duplex
+        uint8_t _tx_bit;
+        uint8_t _half_duplex;              // 1 when 'setHalfDuplex(true)'
+        volatile uint8_t _hd_tx;           // 1 while half duplex is driving the line
+        uint8_t _multidrop;                // 1 after 'beginMultidrop()'
+        volatile uint8_t _md_addr;         // my multidrop address
+        serialReceiveCallback _rx_cb;      // 'onReceive()' callback, NULL for the RX buffer
+        void *_rx_cb_ctx;
         bool transmitting;
-        
+        int8_t _dma_tx;                    // DMA channel for TX, -1 if not used
+        volatile unsigned int _dma_tx_len; // bytes in the current DMA TX block, 0 when idle
+        int8_t _dma_rx;                    // DMA channel for RX, -1 if not used
+        uint8_t _rx_idle_ms;               // DMA RX idle timeout, in 'ticks' of appx 1ms
+        uint8_t _rx_idle_count;            // ticks since the last received byte
+        unsigned int _rx_idle_pos;         // DMA write position at the last tick
+        volatile uint8_t _rx_idle;         // 1 when the line went idle after receiving something
+        uint8_t _rx_active;                // 1 while bytes are arriving
+        uint8_t _tx_policy;                // what 'write()' does when the TX buffer is full
+        unsigned long _tx_dropped;         // bytes NOT sent because the TX buffer was full
+        unsigned long _baud_actual;        // baud rate from the last 'begin()', 0 if it failed
+        unsigned long _baud_ppm;           // and its error in ppm
+
+        void dma_tx_start(void);
+        void hd_tx_start(void);
+        void flow_set(PORT_t *pRTS, uint8_t bRTS, PORT_t *pCTS, uint8_t bCTS, unsigned int iHigh, unsigned int iLow);
+        unsigned int dma_rx_pos(void);
+
     public:
-        HardwareSerial(ring_buffer *rx_buffer, ring_buffer *tx_buffer, uint16_t usart)  __attribute__ ((noinline));
+        HardwareSerial(ring_buffer *rx_buffer, ring_buffer *tx_buffer, SERIAL_STATS *stats, uint16_t usart)  __attribute__ ((noinline));
         void init(ring_buffer *rx_buffer, ring_buffer *tx_buffer, uint16_t usart) __attribute__ ((noinline));
         void begin(unsigned long);
         void begin(unsigned long, uint8_t);
+        // sizes are rounded up to a power of 2.  A DMA mode from 'enableDMA()' stays on (with the new buffers)
+        void begin(unsigned long baud, uint8_t config, unsigned int rxSize, unsigned int txSize);
+        // auto baud - measures the incoming data and starts at the closest rate in 'candidates'
+        // (0 terminated).  returns that rate, or 0 after 'timeoutMs' (the port is then running at
+        // 'candidates[0]').  The data must have a single bit pulse (like 'U' or '$'), interrupts
+        // must be on, and SERIAL_AUTOBAUD_TIMER (TCE0) must be free ('timerClaim()').  The first
+        // frame is measured, and receiving starts after the next idle gap of one frame time
+        unsigned long beginAuto(const unsigned long *candidates, uint8_t config = 0x03 /* SERIAL_8N1 */, unsigned long timeoutMs = 1000);
         void end();
         virtual int available(void);
         virtual int peek(void);
@@ -63,10 +130,107 @@ class HardwareSerial : public Stream
         inline size_t write(long n) { return write((uint8_t)n); }
         inline size_t write(unsigned int n) { return write((uint8_t)n); }
         inline size_t write(int n) { return write((uint8_t)n); }
+        virtual size_t write(const uint8_t *buffer, size_t size); // one buffer update per chunk, not per byte
         using Print::write; // pull in write(str) and write(buf, size) from Print
         operator bool();
+
+        // free space in the TX buffer - writing this many bytes will not block
+        virtual int availableForWrite(void);
+
+        // what to do when the TX buffer is full - see 'SERIAL_TX_xx'.  With anything other than
+        // SERIAL_TX_BLOCK, 'write()' never waits, and returns a short count for dropped bytes
+        inline void setTxPolicy(uint8_t policy) { _tx_policy = policy; }
+        inline uint8_t txPolicy(void) { return _tx_policy; }
+        unsigned long txDropped(bool bClear = false); // number of dropped bytes
+
+        // the baud rate you really got from 'begin()' (0 if not possible) and its error in ppm
+        inline unsigned long actualBaud(void) { return _baud_actual; }
+        inline unsigned long baudErrorPPM(void) { return _baud_ppm; }
+
+        // RX hook - see 'serialRxHook'.  It runs in the ISR, so keep it short!  Not with DMA RX.
+        // 'setRxHook(NULL, NULL)' removes it
+        void setRxHook(serialRxHook pHook, void *pCtx);
+
+        // invert the RX and/or TX pin (e.g. SBUS).  call after 'begin()'
+        void setInverted(bool bRX, bool bTX);
+
+        // bridge to 'other' - every byte received by one port is sent by the other, inside the
+        // RXC ISRs.  It ends after 'count' bytes in both directions (0 for no limit), after 'idleMs'
+        // (appx) with no data (0 for no timeout), or with 'endBridge()'.  It replaces the RX hooks
+        // of both ports.  returns 'false' with DMA RX or 'onReceive()'.  Only one bridge at a time
+        bool bridge(HardwareSerial &other, unsigned long count = 0, uint16_t idleMs = 0);
+        void endBridge(void);
+        bool bridging(void); // 'true' while this port is bridged
+
+        // RTS/CTS flow control on any pin (-1 for none).  RTS goes HIGH at 'highWater' bytes in the
+        // RX buffer, and LOW again at 'lowWater' (0 for the defaults).  call after 'begin()', which
+        // goes back to the pins in 'pins_arduino.h'.  returns 'false' with DMA or a bad pin
+        bool setFlowControl(int rtsPin, int ctsPin, unsigned int highWater = 0, unsigned int lowWater = 0);
+
+        // single wire half duplex - TX and RX pins tied together, TX is only driven while sending,
+        // and the receiver is off meanwhile (no echo).  call after 'begin()' and 'setInverted()'.
+        // returns 'false' without a TXC ISR for the port, or with DMA
+        bool setHalfDuplex(bool bEnable);
+
+        // 9-bit frames (SERIAL_9N1, SERIAL_9N2) - 'read9()' returns the 9th bit as bit 8, and
+        // 'write9()' sends one 9-bit frame after everything in the TX buffer (it waits for that)
+        int read9(void);
+        size_t write9(uint16_t c);
+
+        // multidrop (RS-485) - 9-bit frames, where the 9th bit marks an address.  The USART ignores
+        // all data until an address frame with 'address' (or SERIAL_MULTIDROP_BROADCAST) comes in,
+        // in hardware.  The address byte is in the RX buffer, with bit 8 set from 'read9()'.
+        // Uses the port's RX hook (it ends 'onReceive()'), and does nothing with DMA RX.  A master
+        // uses 'begin(baud, SERIAL_9N1)' and 'writeAddress()'
+        void beginMultidrop(unsigned long baud, uint8_t address);
+        inline void setMultidropAddress(uint8_t address) { _md_addr = address; }
+        inline size_t writeAddress(uint8_t address) { return write9(0x100 | address); }
+
+        // direct receive - every byte goes straight from the RXC ISR to 'pCallback' (see
+        // 'serialReceiveCallback'), NOT into the RX buffer.  Uses the port's RX hook.  returns
+        // 'false' with DMA RX, multidrop, a bridge, 9-bit frames, or another RX hook in place.
+        // 'onReceive(NULL)' goes back to the RX buffer, as does 'begin()' with 9-bit frames
+        bool onReceive(serialReceiveCallback pCallback, void *pCtx = NULL);
+
+        // gap framing - a gap of more than 'gapUs' between 2 received bytes ends a frame, and the
+        // 'micros()' of the first byte of each frame is kept.  '0' turns it off.  returns 'false'
+        // with DMA RX or when there's no memory.  Use 'readFrame()' rather than 'read()' with it
+        bool setFrameGap(unsigned long gapUs);
+        // copies the oldest complete frame (anything after 'maxLen' bytes is dropped) and the time of
+        // its first byte.  returns the number of bytes copied, -1 if no frame is complete yet
+        int readFrame(uint8_t *buf, unsigned int maxLen, unsigned long *pTime = NULL);
+
+        // receive error counters and RX buffer high water mark (not counted with DMA RX)
+        SERIAL_STATS stats(bool bClear = false);
+
+        // DMA - call after 'begin()'.  returns 'false' if no DMA channel is available
+        // (or flow control is enabled on the port).  'enableDMA(0)' turns it off again.
+        bool enableDMA(uint8_t mode);
+
+        // DMA RX - number of idle 'ticks' (appx 1ms each) that end a frame, default 2.  NOTE:  this
+        // is NOT a character-time timeout.  The end of a frame shows 'ms' to 'ms + 1' ticks after
+        // the last byte, so frames need a gap longer than that (~2ms by default) to be told apart
+        inline void setRxIdleTimeout(uint8_t ms) { _rx_idle_ms = ms ? ms : 1; }
+        // returns 'true' once after the line went idle following received data (DMA RX only)
+        bool rxIdle(void);
+
+        void dma_tx_done(void); // called by the DMA interrupt - not for use by sketches
+        void dma_rx_tick(void); // called by the idle timer interrupt - not for use by sketches
+        void hd_tx_done(void);  // called by the TXC interrupt - not for use by sketches
+        bool tx_isr(uint8_t c); // send from an ISR, never waits - not for use by sketches
+        bool md_rx(uint8_t c, uint8_t stat); // multidrop address filter (RX hook) - not for use by sketches
+        bool rx_direct(uint8_t c, uint8_t stat); // 'onReceive()' (RX hook) - not for use by sketches
 };
 
+// modes for 'enableDMA'
+#define SERIAL_DMA_TX 1 /* transmit buffer is sent by DMA with one interrupt per block */
+#define SERIAL_DMA_RX 2 /* receive buffer is filled by DMA with NO interrupts, plus idle detection */
+
+// policies for 'setTxPolicy'
+#define SERIAL_TX_BLOCK       0 /* wait for space (default, same as always) */
+#define SERIAL_TX_DROP_NEW    1 /* drop what doesn't fit */
+#define SERIAL_TX_DROP_OLDEST 2 /* drop the oldest unsent bytes to make room (DROP_NEW with DMA TX) */
+
 // Define config for Serial.begin(baud, config);
 // PMODE 5:4   00=none  10=even 11=odd
 // SBMODE 3    0=1 stop  1=2 stop
@@ -100,6 +264,10 @@ class HardwareSerial : public Stream
 #define SERIAL_6O2 (SERIAL_6N2 | SERIAL_ODD_PARITY)
 #define SERIAL_7O2 (SERIAL_7N2 | SERIAL_ODD_PARITY)
 #define SERIAL_8O2 (SERIAL_8N2 | SERIAL_ODD_PARITY)
+#define SERIAL_9N1 0x07
+#define SERIAL_9N2 (SERIAL_9N1 | SERIAL_TWO_STOP)
+
+#define SERIAL_MULTIDROP_BROADCAST 0xff /* address that every node accepts */
 
 
 // this is where I must include 'pins_arduino.h' 
@@ -137,6 +137,13 @@ static const uint16_t aPreScaler[] PROGMEM = {1,2,4,8,64,256,1024}; // pre-scale
     return;
   }
 
+#if NUM_DIGITAL_PINS > 18 && NUM_DIGITAL_PINS <= 22 /* TCE0 is not a PWM timer, others share it */
+  if(!timerClaim(&TCE0, TIMER_OWNER_TONE)) // softPWM, SoftwareSerial or 'Serial.beginAuto()' has it
+  {
+    return;
+  }
+#endif // NUM_DIGITAL_PINS
+
   ulTemp = frequency * 16384L; // ideal counter 16384
 
   for(b1=sizeof(aPreScaler)/sizeof(aPreScaler[0]) - 1; b1 > 0; b1--)
@@ -240,6 +247,9 @@ void disableTimer(uint8_t _timer)
   TCE0_CCC = 255;
   TCE0_CCD = 255;
 
+  // the 4 PORTE pins have no PWM, so softPWM, SoftwareSerial and 'Serial.beginAuto()' may use TCE0 now
+  timerRelease(&TCE0, TIMER_OWNER_TONE);
+
 #endif // 8/16 bit timer on E
 
 #elif defined(TCC4) // E series and anything else with 'TCC4'
@@ -309,6 +319,9 @@ void disableTimer(uint8_t _timer)
 
 void noTone(uint8_t _pin)
 {
+#if NUM_DIGITAL_PINS > 18 && NUM_DIGITAL_PINS <= 22
+  if(timerOwner(&TCE0) == TIMER_OWNER_TONE) // don't stop TCE0 if somebody else is using it
+#endif // NUM_DIGITAL_PINS
   disableTimer(0);
 
   digitalWrite(_pin, 0);
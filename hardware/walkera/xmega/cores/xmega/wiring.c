@@ -455,6 +455,70 @@ void clock_setup(void)
 #endif
 }
 
+// The timer Hi-Res extension needs 'clkPER4' running at 4 times 'clkPER' (A manual sect 15.1).
+// With the default setup all 3 clocks are the same, so I switch the system clock to the PLL
+// at 4 times F_CPU, and then divide by 2 twice with pre-scalers B and C.  The CPU and the
+// peripheral clock stay at F_CPU, so nothing else (millis, baud rates, ADC) changes.
+// Returns non-zero if 'clkPER4' is (now) 4 times 'clkPER'.
+uint8_t clock_setup_per4(void)
+{
+  uint8_t oldSREG;
+  unsigned short sCtr;
+
+  if((CLK_PSCTRL & CLK_PSBCDIV_gm) == CLK_PSBCDIV_2_2_gc) // already done
+  {
+    return 1;
+  }
+
+  if(CLK_LOCK & CLK_LOCK_bm) // clock is locked, can't change it
+  {
+    return 0;
+  }
+
+  // the PLL multiplies from 'F_CPU' (crystal) or 32Mhz / 4 (internal 32Mhz, sect 6.4.1)
+  // to 'F_CPU * 4'.  The factor is limited to 1-31 (sect 6.10.6)
+#if defined(ARDUINO_RX2634H) || defined(ARDUINO_RX2635H)
+  OSC_PLLCTRL = OSC_PLLSRC_XOSC_gc | 4;
+#elif (F_CPU % 2000000UL) == 0 && F_CPU >= 2000000UL && F_CPU <= 62000000UL
+  OSC_PLLCTRL = OSC_PLLSRC_RC32M_gc | (uint8_t)(F_CPU / 2000000UL); // 8Mhz * F_CPU / 2Mhz
+#else // F_CPU not a multiple of 2Mhz
+  return 0; // no whole PLL factor gives 'F_CPU * 4'
+#endif
+
+  OSC_CTRL |= OSC_PLLEN_bm;
+
+  // same as 'clock_setup()' - no infinite loops, leave the clock alone if it's not 'ready'
+  for(sCtr=32767; sCtr > 0; sCtr--)
+  {
+    if(OSC_STATUS & OSC_PLLRDY_bm) // PLL is locked (6.10.2)
+    {
+      break;
+    }
+  }
+
+  if(!(OSC_STATUS & OSC_PLLRDY_bm))
+  {
+    OSC_CTRL &= ~OSC_PLLEN_bm; // PLL off again
+
+    return 0;
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  // pre-scalers FIRST, so the CPU never runs faster than F_CPU.  For a moment it runs at
+  // F_CPU / 4, which is only a few cycles and does not affect anything timer-based
+  CCP = CCP_IOREG_gc; // 0xd8 - see D manual, sect 3.14.1 (protected I/O)
+  CLK_PSCTRL = CLK_PSADIV_1_gc | CLK_PSBCDIV_2_2_gc; // sect 6.9.2
+
+  CCP = CCP_IOREG_gc;
+  CLK_CTRL = CLK_SCLKSEL_PLL_gc; // sect 6.9.1
+
+  SREG = oldSREG;
+
+  return 1;
+}
+
 
 // this was derived from a message board post.  The function is public to make it easy to
 // use the 'Production Signature Row'.  There is a unique identifier for the CPU as well as
@@ -477,6 +541,100 @@ uint8_t readCalibrationData(uint16_t iIndex)
 }
 
 
+// timer owners - a timer without PWM pins (TCE0 with a 4-pin PORTE) is shared by 'tone()',
+// software PWM, SoftwareSerial and auto baud.  'init()' starts it anyway, so the running state
+// says nothing about who uses it.  The table only holds timers that are claimed right now.
+#ifndef TIMER_OWNER_SLOTS
+#define TIMER_OWNER_SLOTS 4
+#endif // TIMER_OWNER_SLOTS
+
+static TC0_t * volatile aTimerPort[TIMER_OWNER_SLOTS];
+static volatile uint8_t aTimerOwner[TIMER_OWNER_SLOTS];
+
+uint8_t timerClaim(TC0_t *port, uint8_t owner)
+{
+uint8_t oldSREG, i1, iFree, rval;
+
+  if(!port || owner == TIMER_OWNER_NONE)
+  {
+    return 0;
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  iFree = TIMER_OWNER_SLOTS;
+  rval = 0;
+
+  for(i1=0; i1 < TIMER_OWNER_SLOTS; i1++)
+  {
+    if(aTimerPort[i1] == port)
+    {
+      rval = aTimerOwner[i1] == owner;
+      goto the_end;
+    }
+
+    if(!aTimerPort[i1] && iFree >= TIMER_OWNER_SLOTS)
+    {
+      iFree = i1;
+    }
+  }
+
+  if(iFree < TIMER_OWNER_SLOTS)
+  {
+    aTimerPort[iFree] = port;
+    aTimerOwner[iFree] = owner;
+    rval = 1;
+  }
+
+the_end:
+  SREG = oldSREG;
+
+  return rval;
+}
+
+void timerRelease(TC0_t *port, uint8_t owner)
+{
+uint8_t oldSREG, i1;
+
+  oldSREG = SREG;
+  cli();
+
+  for(i1=0; i1 < TIMER_OWNER_SLOTS; i1++)
+  {
+    if(aTimerPort[i1] == port && aTimerOwner[i1] == owner)
+    {
+      aTimerPort[i1] = NULL;
+      aTimerOwner[i1] = TIMER_OWNER_NONE;
+    }
+  }
+
+  SREG = oldSREG;
+}
+
+uint8_t timerOwner(TC0_t *port)
+{
+uint8_t oldSREG, i1, rval;
+
+  oldSREG = SREG;
+  cli();
+
+  rval = TIMER_OWNER_NONE;
+
+  for(i1=0; i1 < TIMER_OWNER_SLOTS; i1++)
+  {
+    if(aTimerPort[i1] == port)
+    {
+      rval = aTimerOwner[i1];
+    }
+  }
+
+  SREG = oldSREG;
+
+  return rval;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                           //
 //   _____  _                          ___         _  _    _         _  _             _    _                 //
@@ -225,6 +225,447 @@ int analogRead(uint8_t pin)
   return iRval / 2;  // -1023 to 1023 [TODO:  clip at zero?]
 }
 
+// 16-bit PWM - analogWriteResolution(), analogWriteFrequency(), analogWrite16()
+//
+// These re-configure the 16-bit timers TCC0 (PC0-PC3), TCC1 (PC4-PC5) and TCD1 (PD4-PD5)
+// as single-slope 16-bit PWM timers, with PER computed for the requested frequency.
+// TCD0 is NOT used here, since it runs the system clock for 'millis()' (see wiring.c) and
+// its period MUST stay at 255.
+//
+// All updates go through the PERBUF and CCxBUF registers, which are copied into PER and CCx
+// by the hardware at the next UPDATE (counter reaching BOTTOM), so changing the duty cycle
+// or the period will never generate a short or a missing pulse.
+// See A manual section 14.7 (double buffering) and 14.8.3 (single slope PWM)
+
+#ifndef TCC1 /* so the table below compiles on CPUs without the 2nd timers */
+#define PWM16_NUM_TIMERS 1
+#elif !defined(TCD1)
+#define PWM16_NUM_TIMERS 2
+#else // TCC0, TCC1, TCD1
+#define PWM16_NUM_TIMERS 3
+#endif // TCC1, TCD1
+
+typedef struct _PWM16_TIMER_
+{
+  uint16_t per;     // period (TOP) currently assigned to PER
+  uint8_t clksel;   // CTRLA clock select, zero if the timer is NOT (yet) in 16-bit PWM mode
+  uint16_t duty[4]; // last value per channel as a 16-bit fraction (0xffff is 'always on')
+} PWM16_TIMER;
+
+static PWM16_TIMER aPWM16[PWM16_NUM_TIMERS];
+
+static uint8_t analog_write_resolution = 8; // bits for 'analogWrite16()' values
+static uint8_t pwm16_hires = 0; // bit 'n' set if Hi-Res is enabled for 'aPWM16[n]'
+
+// pre-scaler values, in the same order as the CTRLA 'CLKSEL' bits (DIV1 is 1, DIV1024 is 7)
+static const uint16_t aPWM16PreScaler[] PROGMEM = {1,2,4,8,64,256,1024};
+
+// get the 16-bit timer, timer index and compare channel for a pin.  returns NULL if the pin
+// has no 16-bit PWM timer.  TC1_t is register-compatible with TC0_t for everything used here
+// (CTRLA-CTRLB, PER, CCA, CCB, PERBUF, CCABUF, CCBBUF), so it is returned as a TC0_t pointer.
+static TC0_t *pwm16_lookup(uint8_t pin, uint8_t *pIndex, uint8_t *pChannel)
+{
+uint8_t port = digitalPinToPort(pin);
+uint8_t bit;
+volatile uint8_t *pDir;
+
+  if(port == NOT_A_PIN)
+  {
+    return NULL;
+  }
+
+  bit = digitalPinToBitMask(pin);
+  bit = pinBitValueToIndex(bit);
+
+  pDir = portModeRegister(port);
+
+  if(pDir == &PORTC_DIR)
+  {
+    if(bit < 4)
+    {
+      *pIndex = 0;
+      *pChannel = bit;
+      return &TCC0;
+    }
+#ifdef TCC1
+    else if(bit < 6)
+    {
+      *pIndex = 1;
+      *pChannel = bit - 4;
+      return (TC0_t *)&TCC1;
+    }
+#endif // TCC1
+  }
+#ifdef TCD1
+  else if(pDir == &PORTD_DIR && bit >= 4 && bit < 6)
+  {
+    *pIndex = 2;
+    *pChannel = bit - 4;
+    return (TC0_t *)&TCD1;
+  }
+#endif // TCD1
+
+  return NULL;
+}
+
+TC0_t *digitalPinToTimer16(uint8_t pin, uint8_t *pChannel)
+{
+uint8_t index;
+
+  return pwm16_lookup(pin, &index, pChannel);
+}
+
+// assign a channel's compare buffer from the 16-bit duty fraction and the current period
+static void pwm16_update_channel(TC0_t *port, uint8_t index, uint8_t channel)
+{
+uint16_t duty = aPWM16[index].duty[channel];
+uint16_t per = aPWM16[index].per;
+uint16_t cc;
+
+  if(duty == 0xffff) // always on - CCx > PER means 'no compare match' and the output stays high
+  {
+    cc = per == 0xffff ? 0xffff : per + 1;
+  }
+  else
+  {
+    cc = (uint16_t)(((uint32_t)duty * ((uint32_t)per + 1)) >> 16);
+  }
+
+  // NOTE:  16-bit registers are written low byte first, then high byte, which is what
+  //        the compiler does for xmega.  see A1U manual sect. 3.11
+  (&(port->CCABUF))[channel] = cc;
+}
+
+// switch a timer into 16-bit single-slope PWM mode, or change the period of one that already is
+static void pwm16_configure(TC0_t *port, uint8_t index, uint8_t clksel, uint16_t per)
+{
+uint8_t i1, oldSREG;
+
+  oldSREG = SREG;
+  cli(); // the 16-bit 'TEMP' register is shared, so no interrupts while I do this
+
+  aPWM16[index].per = per;
+
+  if(aPWM16[index].clksel == clksel)
+  {
+    // same clock, only the period changes.  PERBUF and CCxBUF are loaded together on UPDATE
+    port->PERBUF = per;
+
+    for(i1=0; i1 < (port == &TCC0 ? 4 : 2); i1++)
+    {
+      pwm16_update_channel(port, index, i1);
+    }
+  }
+  else
+  {
+    // NOTE:  for TCC0 this ends split mode, so the 8-bit PWM on PC4-PC7 (HCMPx) stops.  From
+    //        here on 'analogWrite()' on those pins is ON/OFF only, unless TCC1 drives PC4-PC5
+    if(!aPWM16[index].clksel) // first time - it was set up as an 8-bit timer in 'init()'
+    {
+      port->CTRLA = 0;                       // timer OFF while I re-configure it
+      port->CTRLFSET = TC_CMD_RESET_gc;      // all registers to their defaults (sect 14.12.6)
+      port->CTRLB = TC_WGMODE_SS_gc;         // single slope PWM, compare outputs enabled on write
+      port->CTRLD = 0;                       // no events
+      port->CTRLE = 0;                       // 16-bit mode
+
+      port->INTCTRLA = 0;                    // no overflow/error interrupts
+      port->INTCTRLB = 0;                    // no compare interrupts
+
+      port->CCA = 0;                         // outputs LOW until a value is written
+      port->CCB = 0;
+      if(port == &TCC0)
+      {
+        port->CCC = 0;
+        port->CCD = 0;
+      }
+    }
+
+    else
+    {
+      // a running timer.  Writing PER directly while CNT is above the new value would let it
+      // count all the way to 0xffff first, so stop it and start the new period from zero
+      port->CTRLA = 0;
+      port->CTRLFSET = TC_CMD_RESTART_gc;    // CNT to zero, compare outputs LOW (sect 14.12.6)
+    }
+
+    port->PER = per;
+    port->PERBUF = per;
+
+    for(i1=0; i1 < (port == &TCC0 ? 4 : 2); i1++)
+    {
+      pwm16_update_channel(port, index, i1);
+    }
+
+    port->CTRLFSET = TC_CMD_UPDATE_gc;       // CCxBUF to CCx now, not at the next UPDATE
+    port->CTRLA = clksel;                    // and go
+  }
+
+  aPWM16[index].clksel = clksel;
+
+  SREG = oldSREG;
+}
+
+// assign a 16-bit duty fraction to a channel and enable its output
+static void pwm16_write(uint8_t pin, TC0_t *port, uint8_t index, uint8_t channel, uint16_t duty)
+{
+uint8_t oldSREG;
+
+  oldSREG = SREG;
+  cli();
+
+  aPWM16[index].duty[channel] = duty;
+  pwm16_update_channel(port, index, channel);
+
+  SREG = oldSREG;
+
+  pinMode(pin, OUTPUT);
+  port->CTRLB |= (TC0_CCAEN_bm << channel); // enable the output (TC1_t uses the same bits)
+}
+
+// Hi-Res extension (A manual sect 15) - the compare units of the timers on ports C and D get 2
+// extra bits, so PER and CCx count 4 times as fast as the (non-prescaled) peripheral clock.
+// This needs 'clkPER4' at 4 times 'clkPER', which 'clock_setup_per4()' does the first time.
+uint8_t timer16HiRes(TC0_t *port, uint8_t bEnable)
+{
+#ifdef HIRESC_CTRLA
+volatile uint8_t *pCtrl;
+uint8_t bBit, index;
+
+  if(port == &TCC0)
+  {
+    pCtrl = &HIRESC_CTRLA;
+    bBit = HIRES_HREN_TC0_gc;
+    index = 0;
+  }
+#ifdef TCC1
+  else if(port == (TC0_t *)&TCC1)
+  {
+    pCtrl = &HIRESC_CTRLA;
+    bBit = HIRES_HREN_TC1_gc;
+    index = 1;
+  }
+#endif // TCC1
+#if defined(TCD1) && defined(HIRESD_CTRLA)
+  else if(port == (TC0_t *)&TCD1)
+  {
+    pCtrl = &HIRESD_CTRLA;
+    bBit = HIRES_HREN_TC1_gc;
+    index = 2;
+  }
+#endif // TCD1, HIRESD_CTRLA
+  else
+  {
+    return 0;
+  }
+
+  if(bEnable)
+  {
+    if(!clock_setup_per4())
+    {
+      return 0;
+    }
+
+    *pCtrl |= bBit;
+    pwm16_hires |= (1 << index);
+  }
+  else
+  {
+    *pCtrl &= ~bBit;
+    pwm16_hires &= ~(1 << index);
+  }
+
+  return 1;
+#else // HIRESC_CTRLA
+
+  return 0;
+
+#endif // HIRESC_CTRLA
+}
+
+unsigned long timer16TickRate(TC0_t *port)
+{
+uint8_t bClk = port->CTRLA & TC0_CLKSEL_gm;
+unsigned long ulRate;
+
+  if(!bClk || bClk > TC_CLKSEL_DIV1024_gc) // off, or an event channel
+  {
+    return 0;
+  }
+
+  ulRate = F_CPU / pgm_read_word(&aPWM16PreScaler[bClk - 1]);
+
+#ifdef HIRESC_CTRLA
+  if((port == &TCC0 && (HIRESC_CTRLA & HIRES_HREN_TC0_gc))
+#ifdef TCC1
+     || (port == (TC0_t *)&TCC1 && (HIRESC_CTRLA & HIRES_HREN_TC1_gc))
+#endif // TCC1
+#if defined(TCD1) && defined(HIRESD_CTRLA)
+     || (port == (TC0_t *)&TCD1 && (HIRESD_CTRLA & HIRES_HREN_TC1_gc))
+#endif // TCD1, HIRESD_CTRLA
+    )
+  {
+    ulRate *= 4;
+  }
+#endif // HIRESC_CTRLA
+
+  return ulRate;
+}
+
+uint8_t analogWriteHiRes(uint8_t pin, uint8_t bEnable)
+{
+TC0_t *port;
+uint8_t index, channel;
+unsigned long ulFreq = 0;
+
+  port = pwm16_lookup(pin, &index, &channel);
+
+  if(!port)
+  {
+    return 0;
+  }
+
+  if(aPWM16[index].clksel) // already running - keep the frequency
+  {
+    ulFreq = timer16TickRate(port) / ((unsigned long)aPWM16[index].per + 1);
+  }
+
+  if(!timer16HiRes(port, bEnable))
+  {
+    return 0;
+  }
+
+  if(ulFreq)
+  {
+    analogWriteFrequency(pin, ulFreq);
+  }
+
+  return 1;
+}
+
+void analogWriteResolution(uint8_t bits)
+{
+  if(bits < 1)
+  {
+    bits = 1;
+  }
+  else if(bits > 16)
+  {
+    bits = 16;
+  }
+
+  analog_write_resolution = bits;
+}
+
+unsigned long analogWriteFrequency(uint8_t pin, unsigned long frequency)
+{
+TC0_t *port;
+uint8_t index, channel, i1;
+unsigned long ulTicks = 0;
+uint16_t wDiv = 1;
+
+  port = pwm16_lookup(pin, &index, &channel);
+
+  if(!port || !frequency)
+  {
+    return 0;
+  }
+
+  if(pwm16_hires & (1 << index)) // Hi-Res - always DIV1, with 4 ticks per peripheral clock
+  {
+    ulTicks = (F_CPU * 4UL) / frequency;
+
+    if(ulTicks > 65536UL) // below appx 1khz (16Mhz) the period is limited to 16 bits
+    {
+      ulTicks = 65536UL;
+    }
+    else if(ulTicks < 8)
+    {
+      ulTicks = 8;
+    }
+
+    pwm16_configure(port, index, TC_CLKSEL_DIV1_gc, (uint16_t)(ulTicks - 1));
+
+    return (F_CPU * 4UL) / ulTicks;
+  }
+
+  // find the smallest pre-scaler that still fits the period into 16 bits.  This gives
+  // the finest duty cycle steps for the requested frequency.
+  for(i1=0; i1 < sizeof(aPWM16PreScaler) / sizeof(aPWM16PreScaler[0]); i1++)
+  {
+    wDiv = pgm_read_word(&aPWM16PreScaler[i1]);
+    ulTicks = (F_CPU / wDiv) / frequency;
+
+    if(ulTicks <= 65536UL)
+    {
+      break;
+    }
+  }
+
+  if(ulTicks > 65536UL) // too slow even for DIV1024, use the longest period available
+  {
+    i1--;
+    ulTicks = 65536UL;
+  }
+  else if(ulTicks < 2) // too fast, use the shortest period that still has 2 steps
+  {
+    ulTicks = 2;
+  }
+
+  pwm16_configure(port, index, i1 + 1, (uint16_t)(ulTicks - 1)); // CLKSEL values begin with DIV1 == 1
+
+  return (F_CPU / wDiv) / ulTicks; // the actual frequency
+}
+
+void analogWrite16(uint8_t pin, uint16_t val)
+{
+TC0_t *port;
+uint8_t index, channel;
+uint16_t duty;
+
+  port = pwm16_lookup(pin, &index, &channel);
+
+  if(!port)
+  {
+    // no 16-bit timer on this pin, use the regular (8-bit) version
+    analogWrite(pin, analog_write_resolution > 8 ? (val >> (analog_write_resolution - 8))
+                                                 : (val << (8 - analog_write_resolution)));
+    return;
+  }
+
+  // convert the value into a 16-bit fraction, with 'all bits set' meaning 'always on'
+  if(analog_write_resolution < 16 && val >= (1U << analog_write_resolution) - 1)
+  {
+    duty = 0xffff;
+  }
+  else
+  {
+    duty = val << (16 - analog_write_resolution);
+  }
+
+  if(!aPWM16[index].clksel) // not in 16-bit mode yet - use a PER that matches the resolution
+  {
+    pwm16_configure(port, index, TC_CLKSEL_DIV1_gc,
+                    (uint16_t)((1UL << analog_write_resolution) - 1));
+  }
+
+  pwm16_write(pin, port, index, channel, duty);
+}
+
+// called by 'digitalWrite()' so that it overrides the waveform output, as with the 8-bit PWM
+void turnOffPWM16(uint8_t pin)
+{
+TC0_t *port;
+uint8_t index, channel;
+
+  port = pwm16_lookup(pin, &index, &channel);
+
+  if(port && aPWM16[index].clksel)
+  {
+    port->CTRLB &= ~(TC0_CCAEN_bm << channel);
+  }
+}
+
+
 // Right now, PWM output only works on the pins with hardware support.
 // These are defined in the appropriate pins_arduino.h file.  For the
 // rest of the pins, we default to digital output with a 1 or 0
@@ -250,6 +691,24 @@ void analogWrite(uint8_t pin, int val)
   uint8_t mode;
 #endif // TCC4
   uint8_t bit = digitalPinToBitMask(pin);
+  TC0_t *port16;
+  uint8_t index16, channel16;
+
+  // software PWM on this port takes priority, since it has to be started explicitly
+  if(softPWMWrite(pin, val < 0 ? 0 : val > 255 ? 255 : val))
+  {
+    return;
+  }
+
+  // a timer that was switched to 16-bit PWM by 'analogWriteFrequency()' or 'analogWrite16()'
+  // keeps its period, and the 8-bit value is scaled to it
+  port16 = pwm16_lookup(pin, &index16, &channel16);
+
+  if(port16 && aPWM16[index16].clksel && val > 0 && val < 255)
+  {
+    pwm16_write(pin, port16, index16, channel16, (uint16_t)val << 8);
+    return;
+  }
 
   pinMode(pin, OUTPUT); // forces 'totem pole' - TODO allow for something different?
 
@@ -356,6 +815,12 @@ void analogWrite(uint8_t pin, int val)
 
       case TIMERC2:
 
+        if(aPWM16[0].clksel && bit > 8) // TCC0 is a 16-bit timer now, there is no HCMPx
+        {
+          digitalWrite(pin, val < 128 ? LOW : HIGH);
+          return;
+        }
+
 #ifndef TCC2
         DoAnalogWriteForPort(&TCC0, bit, val);
 #else // TCC2 defined
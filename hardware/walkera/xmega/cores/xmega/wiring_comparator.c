@@ -0,0 +1,312 @@
+/*
+  wiring_comparator.c - analog comparator functions
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+
+  The analog comparators on PORTA (ACA, AC0 and AC1) compare 2 inputs within a fraction of
+  a microsecond (in high speed mode).  The output can fire an interrupt, be read directly, or
+  go through the event system to the fault input of the AWEX on TCC0, which turns the PWM
+  outputs off in hardware with NO software involved.  See A manual sect 29 (AC), 6 (event
+  system) and 15 (AWEX fault protection).
+
+  Typical overcurrent trip, shunt amplifier on A1, trip point at 'Vcc * 40/64':
+
+    analogComparatorScaler(39);
+    analogComparatorBegin(0, A1, AC_INPUT_SCALER, AC_HYSTERESIS_SMALL);
+    analogComparatorFault(0, 0, 0x0f, 1); // event channel 0, PC0-PC3, latched
+*/
+
+#include "wiring_private.h"
+#include "pins_arduino.h"
+
+#ifdef ACA_AC0CTRL
+
+static volatile voidFuncPtr ac_callback[2] = { NULL, NULL };
+
+#ifdef AWEXC_CTRL
+static uint8_t ac_fault_pins = 0; // pins on PORTC that the fault turns off
+#endif // AWEXC_CTRL
+
+
+// convert an analog pin (A0-A7, or 0-7) into the PORTA pin number, or 0xff if it's not valid
+static uint8_t ac_pin(uint8_t pin)
+{
+  if(pin >= A0)
+  {
+#ifdef analogInputToAnalogPin
+    pin = analogInputToAnalogPin(pin);
+#else // analogInputToAnalogPin
+    pin -= A0;
+#endif // analogInputToAnalogPin
+  }
+
+  return pin < 8 ? pin : 0xff; // only PORTA pins go to ACA
+}
+
+uint8_t analogComparatorBegin(uint8_t comparator, uint8_t posInput, uint8_t negInput, uint8_t hysteresis)
+{
+uint8_t bPos, bNeg;
+
+  if(comparator > 1)
+  {
+    return 0;
+  }
+
+  // positive input - PA0 to PA6, or the DAC (sect 29.8.3)
+  if(posInput == AC_INPUT_DAC)
+  {
+    bPos = AC_MUXPOS_DAC_gc;
+  }
+  else
+  {
+    bPos = ac_pin(posInput);
+
+    if(bPos > 6)
+    {
+      return 0;
+    }
+
+    bPos <<= AC_MUXPOS_gp;
+  }
+
+  // negative input - PA0, PA1, PA3, PA5, PA7, the DAC, the bandgap, or the Vcc scaler
+  switch(negInput)
+  {
+    case AC_INPUT_DAC:
+      bNeg = AC_MUXNEG_DAC_gc;
+      break;
+
+    case AC_INPUT_BANDGAP:
+      bNeg = AC_MUXNEG_BANDGAP_gc;
+      break;
+
+    case AC_INPUT_SCALER:
+      bNeg = AC_MUXNEG_SCALER_gc;
+      break;
+
+    default:
+      switch(ac_pin(negInput))
+      {
+        case 0: bNeg = AC_MUXNEG_PIN0_gc; break;
+        case 1: bNeg = AC_MUXNEG_PIN1_gc; break;
+        case 3: bNeg = AC_MUXNEG_PIN3_gc; break;
+        case 5: bNeg = AC_MUXNEG_PIN5_gc; break;
+        case 7: bNeg = AC_MUXNEG_PIN7_gc; break;
+        default:
+          return 0;
+      }
+  }
+
+  if(hysteresis > AC_HYSTERESIS_LARGE)
+  {
+    hysteresis = AC_HYSTERESIS_LARGE;
+  }
+
+  if(!comparator)
+  {
+    ACA_AC0CTRL = 0; // off while I change the inputs
+    ACA_AC0MUXCTRL = bPos | bNeg;
+    ACA_AC0CTRL = AC_HSMODE_bm | (hysteresis << AC_HYSMODE_gp) | AC_ENABLE_bm;
+  }
+  else
+  {
+    ACA_AC1CTRL = 0;
+    ACA_AC1MUXCTRL = bPos | bNeg;
+    ACA_AC1CTRL = AC_HSMODE_bm | (hysteresis << AC_HYSMODE_gp) | AC_ENABLE_bm;
+  }
+
+  // the output needs appx 0.2us (high speed) after enable plus a small startup time,
+  // so wait a little before anybody reads it (sect 29.3)
+  delayMicroseconds(2);
+
+  return 1;
+}
+
+void analogComparatorEnd(uint8_t comparator)
+{
+  analogComparatorDetachInterrupt(comparator);
+
+  if(!comparator)
+  {
+    ACA_AC0CTRL = 0;
+  }
+  else if(comparator == 1)
+  {
+    ACA_AC1CTRL = 0;
+  }
+}
+
+void analogComparatorScaler(uint8_t scale)
+{
+  ACA_CTRLB = scale & AC_SCALEFAC_gm; // Vcc * (scale + 1) / 64 (sect 29.8.6)
+}
+
+uint8_t analogComparatorRead(uint8_t comparator)
+{
+  return (ACA_STATUS & (comparator ? AC_AC1STATE_bm : AC_AC0STATE_bm)) ? HIGH : LOW;
+}
+
+void analogComparatorAttachInterrupt(uint8_t comparator, void (*userFunc)(void), int mode)
+{
+uint8_t bMode, oldSREG;
+
+  if(comparator > 1)
+  {
+    return;
+  }
+
+  switch(mode)
+  {
+    case RISING:
+      bMode = AC_INTMODE_RISING_gc;
+      break;
+
+    case FALLING:
+      bMode = AC_INTMODE_FALLING_gc;
+      break;
+
+    default:
+      bMode = AC_INTMODE_BOTHEDGES_gc;
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  ac_callback[comparator] = userFunc;
+
+  // the interrupt mode also selects the edge for the event output
+  if(!comparator)
+  {
+    ACA_STATUS = AC_AC0IF_bm; // clear any old flag
+    ACA_AC0CTRL = (ACA_AC0CTRL & ~(AC_INTMODE_gm | AC_INTLVL_gm)) | bMode | AC_INTLVL_HI_gc;
+  }
+  else
+  {
+    ACA_STATUS = AC_AC1IF_bm;
+    ACA_AC1CTRL = (ACA_AC1CTRL & ~(AC_INTMODE_gm | AC_INTLVL_gm)) | bMode | AC_INTLVL_HI_gc;
+  }
+
+  SREG = oldSREG;
+}
+
+void analogComparatorDetachInterrupt(uint8_t comparator)
+{
+uint8_t oldSREG;
+
+  if(comparator > 1)
+  {
+    return;
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  if(!comparator)
+  {
+    ACA_AC0CTRL &= ~AC_INTLVL_gm;
+  }
+  else
+  {
+    ACA_AC1CTRL &= ~AC_INTLVL_gm;
+  }
+
+  ac_callback[comparator] = NULL;
+
+  SREG = oldSREG;
+}
+
+// Fault protection - the comparator output goes through event channel 'eventChannel' to the AWEX
+// fault detection on TCC0.  On a fault, the hardware clears the DIR bits for 'pinMask' on PORTC,
+// so the PWM pins float (use pull-downs on the gate drivers).  When 'latched' is non-zero, the
+// pins stay off until 'analogComparatorFaultClear()', otherwise they come back at the next
+// timer UPDATE ('cycle by cycle' mode).  See A manual sect 15.4.6 and 15.6.
+uint8_t analogComparatorFault(uint8_t comparator, uint8_t eventChannel, uint8_t pinMask, uint8_t latched)
+{
+#ifdef AWEXC_CTRL
+volatile uint8_t *pMux;
+
+  if(comparator > 1 || eventChannel > 7)
+  {
+    return 0;
+  }
+
+  pMux = &EVSYS_CH0MUX + eventChannel; // CH0MUX - CH7MUX are sequential (sect 6.8.1)
+
+  *pMux = comparator ? EVSYS_CHMUX_ACA_CH1_gc : EVSYS_CHMUX_ACA_CH0_gc;
+
+  ac_fault_pins = pinMask;
+
+  // the AWEX takes over the pins - with dead time and pattern generation off, the
+  // timer's compare outputs go straight through
+  AWEXC_CTRL = 0;
+  AWEXC_OUTOVEN = pinMask;
+  AWEXC_STATUS = AWEX_FDF_bm; // clear any old fault
+
+  AWEXC_FDEMASK = _BV(eventChannel);
+  AWEXC_FDCTRL = AWEX_FDACT_CLEARDIR_gc | (latched ? 0 : AWEX_FDMODE_bm);
+
+  return 1;
+#else // AWEXC_CTRL
+
+  return 0;
+
+#endif // AWEXC_CTRL
+}
+
+void analogComparatorFaultClear(void)
+{
+#ifdef AWEXC_CTRL
+  AWEXC_STATUS = AWEX_FDF_bm; // only clears when the fault condition is gone
+
+  if(!(AWEXC_STATUS & AWEX_FDF_bm))
+  {
+    PORTC_DIRSET = ac_fault_pins; // 'CLEARDIR' does not restore the pins
+  }
+#endif // AWEXC_CTRL
+}
+
+void analogComparatorFaultEnd(void)
+{
+#ifdef AWEXC_CTRL
+  AWEXC_FDEMASK = 0;
+  AWEXC_FDCTRL = 0;
+  AWEXC_OUTOVEN = 0;
+  AWEXC_STATUS = AWEX_FDF_bm;
+
+  PORTC_DIRSET = ac_fault_pins;
+  ac_fault_pins = 0;
+#endif // AWEXC_CTRL
+}
+
+
+ISR(ACA_AC0_vect)
+{
+  if(ac_callback[0])
+  {
+    ac_callback[0]();
+  }
+}
+
+ISR(ACA_AC1_vect)
+{
+  if(ac_callback[1])
+  {
+    ac_callback[1]();
+  }
+}
+
+#endif // ACA_AC0CTRL
@@ -364,8 +364,11 @@ void digitalWrite(uint8_t pin, uint8_t val)
   if (timer != NOT_ON_TIMER)
   {
     turnOffPWM(timer, bit);
+    turnOffPWM16(pin); // in case 'analogWrite16()' switched it to a 16-bit timer
   }
 
+  turnOffSoftPWM(pin); // does nothing unless the pin is on the software PWM port
+
   out = portOutputRegister(port);
 
   uint8_t oldSREG = SREG;
@@ -406,6 +409,7 @@ int digitalRead(uint8_t pin)
   if (timer != NOT_ON_TIMER)
   {
     turnOffPWM(timer, bit);
+    turnOffPWM16(pin); // in case 'analogWrite16()' switched it to a 16-bit timer
   }
 
   bSet = (*portInputRegister(port) & bit) ? true : false;
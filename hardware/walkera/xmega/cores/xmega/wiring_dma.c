@@ -0,0 +1,368 @@
+/*
+  wiring_dma.c - DMA controller driver
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+
+  See wiring_dma.h for a description
+*/
+
+#include "wiring_private.h"
+#include "pins_arduino.h"
+
+#ifdef DMA_CTRL
+
+typedef struct _DMA_CHANNEL_INFO_
+{
+  dmaCallback pCallback;
+  void *pCtx;
+  uint8_t bFill;       // source byte for 'dmaMemset'
+  uint8_t bAutoFree;   // free the channel on completion ('dmaMemcpy', 'dmaMemset')
+} DMA_CHANNEL_INFO;
+
+static DMA_CHANNEL_INFO dma_info[DMA_NUM_CHANNELS];
+static uint8_t dma_alloc = 0; // bit 'n' set when channel 'n' is in use
+
+
+DMA_CH_t *dmaChannel(uint8_t bChannel)
+{
+  return &(DMA.CH0) + bChannel; // the channel registers are sequential (sect 5.14)
+}
+
+int8_t dmaAllocChannel(void)
+{
+uint8_t i1, oldSREG;
+
+  oldSREG = SREG;
+  cli();
+
+  // highest channel first, so that 'dmaAllocPair' is more likely to find a pair
+  for(i1=DMA_NUM_CHANNELS; i1 > 0; i1--)
+  {
+    if(!(dma_alloc & _BV(i1 - 1)))
+    {
+      dma_alloc |= _BV(i1 - 1);
+
+      SREG = oldSREG;
+
+      DMA.CTRL |= DMA_ENABLE_bm;
+      memset(&(dma_info[i1 - 1]), 0, sizeof(dma_info[0]));
+
+      return i1 - 1;
+    }
+  }
+
+  SREG = oldSREG;
+
+  return -1;
+}
+
+int8_t dmaAllocPair(void)
+{
+uint8_t i1, oldSREG;
+
+  oldSREG = SREG;
+  cli();
+
+  for(i1=0; i1 < DMA_NUM_CHANNELS; i1 += 2)
+  {
+    if(!(dma_alloc & (3 << i1)))
+    {
+      dma_alloc |= (3 << i1);
+
+      SREG = oldSREG;
+
+      DMA.CTRL |= DMA_ENABLE_bm;
+      memset(&(dma_info[i1]), 0, 2 * sizeof(dma_info[0]));
+
+      return i1;
+    }
+  }
+
+  SREG = oldSREG;
+
+  return -1;
+}
+
+void dmaFreeChannel(uint8_t bChannel)
+{
+uint8_t oldSREG;
+
+  if(bChannel >= DMA_NUM_CHANNELS)
+  {
+    return;
+  }
+
+  dmaStop(bChannel);
+
+  oldSREG = SREG;
+  cli();
+
+  dma_info[bChannel].pCallback = NULL;
+  dma_alloc &= ~_BV(bChannel);
+
+  if(!dma_alloc)
+  {
+    DMA.CTRL = 0; // nobody uses it, so shut it off
+  }
+
+  SREG = oldSREG;
+}
+
+void dmaSetup(uint8_t bChannel, const DMA_SETUP *pSetup)
+{
+DMA_CH_t *pCH = dmaChannel(bChannel);
+uint16_t wAddr;
+
+  pCH->CTRLA = 0;               // disable it first - registers can't change while it's enabled
+  pCH->CTRLA = DMA_CH_RESET_bm; // all registers to their defaults (sect 5.15.1)
+
+  pCH->ADDRCTRL = pSetup->bAddrCtrl;
+  pCH->TRIGSRC = pSetup->bTrigger;
+  pCH->TRFCNT = pSetup->wCount;
+  pCH->REPCNT = pSetup->bRepeat;
+
+  // SRAM and I/O are both below 64k, so the 3rd address byte is always zero
+  wAddr = (uint16_t)pSetup->pSrc;
+  pCH->SRCADDR0 = (uint8_t)wAddr;
+  pCH->SRCADDR1 = (uint8_t)(wAddr >> 8);
+  pCH->SRCADDR2 = 0;
+
+  wAddr = (uint16_t)pSetup->pDest;
+  pCH->DESTADDR0 = (uint8_t)wAddr;
+  pCH->DESTADDR1 = (uint8_t)(wAddr >> 8);
+  pCH->DESTADDR2 = 0;
+
+  // 'CTRLA' is written by 'dmaStart()', except for these bits
+  pCH->CTRLA = pSetup->bBurst
+             | (pSetup->bRepeat != 1 ? DMA_CH_REPEAT_bm : 0)
+             | ((pSetup->bFlags & DMA_SINGLE) ? DMA_CH_SINGLE_bm : 0);
+
+  pCH->CTRLB = DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm   // clear old flags (write 1 to clear)
+             | (dma_info[bChannel].pCallback ? (DMA_CH_TRNINTLVL_MED_gc | DMA_CH_ERRINTLVL_MED_gc) : 0);
+}
+
+void dmaSetCallback(uint8_t bChannel, dmaCallback pCallback, void *pCtx)
+{
+DMA_CH_t *pCH = dmaChannel(bChannel);
+uint8_t oldSREG;
+
+  oldSREG = SREG;
+  cli();
+
+  dma_info[bChannel].pCallback = pCallback;
+  dma_info[bChannel].pCtx = pCtx;
+
+  // interrupts are also needed to free 'auto free' channels
+  if(pCallback || dma_info[bChannel].bAutoFree)
+  {
+    pCH->CTRLB = (pCH->CTRLB & ~(DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm | DMA_CH_ERRINTLVL_gm | DMA_CH_TRNINTLVL_gm))
+               | DMA_CH_TRNINTLVL_MED_gc | DMA_CH_ERRINTLVL_MED_gc;
+  }
+  else
+  {
+    pCH->CTRLB &= ~(DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm | DMA_CH_ERRINTLVL_gm | DMA_CH_TRNINTLVL_gm);
+  }
+
+  SREG = oldSREG;
+}
+
+void dmaStart(uint8_t bChannel)
+{
+DMA_CH_t *pCH = dmaChannel(bChannel);
+
+  pCH->CTRLA |= DMA_CH_ENABLE_bm;
+
+  if(pCH->TRIGSRC == DMA_CH_TRIGSRC_OFF_gc)
+  {
+    pCH->CTRLA |= DMA_CH_TRFREQ_bm; // no trigger source, so start it now
+  }
+}
+
+void dmaTrigger(uint8_t bChannel)
+{
+  dmaChannel(bChannel)->CTRLA |= DMA_CH_TRFREQ_bm;
+}
+
+void dmaStop(uint8_t bChannel)
+{
+DMA_CH_t *pCH = dmaChannel(bChannel);
+
+  pCH->CTRLA &= ~DMA_CH_ENABLE_bm;
+
+  while(pCH->CTRLB & DMA_CH_CHBUSY_bm) // an active burst completes first (sect 5.5)
+  { }
+}
+
+uint8_t dmaBusy(uint8_t bChannel)
+{
+  return (dmaChannel(bChannel)->CTRLB & (DMA_CH_CHBUSY_bm | DMA_CH_CHPEND_bm))
+         || (dmaChannel(bChannel)->CTRLA & DMA_CH_ENABLE_bm) ? 1 : 0;
+}
+
+uint16_t dmaRemaining(uint8_t bChannel)
+{
+uint16_t wRval;
+uint8_t oldSREG;
+
+  oldSREG = SREG;
+  cli(); // 16-bit read uses the 'TEMP' register
+
+  wRval = dmaChannel(bChannel)->TRFCNT;
+
+  SREG = oldSREG;
+
+  return wRval;
+}
+
+void dmaDoubleBuffer(uint8_t bFirstChannel, uint8_t bEnable)
+{
+uint8_t bMode, oldSREG;
+
+  // 'DBUFMODE' pairs channels 0+1 and 2+3 (sect 5.14.1)
+  bMode = bFirstChannel < 2 ? DMA_DBUFMODE_CH01_gc : DMA_DBUFMODE_CH23_gc;
+
+  oldSREG = SREG;
+  cli();
+
+  if(bEnable)
+  {
+    // if the other pair is already on, both are
+    if((DMA.CTRL & DMA_DBUFMODE_gm) != DMA_DBUFMODE_DISABLED_gc
+       && (DMA.CTRL & DMA_DBUFMODE_gm) != bMode)
+    {
+      bMode = DMA_DBUFMODE_CH01CH23_gc;
+    }
+
+    DMA.CTRL = (DMA.CTRL & ~DMA_DBUFMODE_gm) | bMode | DMA_ENABLE_bm;
+
+    SREG = oldSREG;
+
+    dmaStart(bFirstChannel & ~1); // the hardware starts the other channel when it's done
+  }
+  else
+  {
+    if((DMA.CTRL & DMA_DBUFMODE_gm) == DMA_DBUFMODE_CH01CH23_gc)
+    {
+      bMode = bFirstChannel < 2 ? DMA_DBUFMODE_CH23_gc : DMA_DBUFMODE_CH01_gc; // the other pair stays on
+    }
+    else
+    {
+      bMode = DMA_DBUFMODE_DISABLED_gc;
+    }
+
+    DMA.CTRL = (DMA.CTRL & ~DMA_DBUFMODE_gm) | bMode;
+
+    SREG = oldSREG;
+  }
+}
+
+static int8_t dma_mem(void *pDest, const void *pSrc, uint8_t bFill, uint8_t bAddrCtrl, uint16_t wLen,
+                      dmaCallback pCallback, void *pCtx)
+{
+DMA_SETUP setup;
+int8_t iCH;
+
+  if(!wLen)
+  {
+    return -1;
+  }
+
+  iCH = dmaAllocChannel();
+
+  if(iCH < 0)
+  {
+    return -1;
+  }
+
+  dma_info[iCH].bFill = bFill;
+  dma_info[iCH].bAutoFree = 1;
+
+  setup.pSrc = pSrc ? pSrc : &(dma_info[iCH].bFill); // 'memset' reads the same byte over and over
+  setup.pDest = pDest;
+  setup.wCount = wLen;
+  setup.bAddrCtrl = bAddrCtrl;
+  setup.bTrigger = DMA_CH_TRIGSRC_OFF_gc;
+  setup.bBurst = (wLen & 7) ? DMA_CH_BURSTLEN_1BYTE_gc : DMA_CH_BURSTLEN_8BYTE_gc;
+  setup.bRepeat = 1;
+  setup.bFlags = 0; // one request moves the whole block
+
+  dmaSetup(iCH, &setup);
+  dmaSetCallback(iCH, pCallback, pCtx);
+  dmaStart(iCH);
+
+  return iCH;
+}
+
+int8_t dmaMemcpy(void *pDest, const void *pSrc, uint16_t wLen, dmaCallback pCallback, void *pCtx)
+{
+  return dma_mem(pDest, pSrc, 0,
+                 DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_INC_gc,
+                 wLen, pCallback, pCtx);
+}
+
+int8_t dmaMemset(void *pDest, uint8_t bVal, uint16_t wLen, dmaCallback pCallback, void *pCtx)
+{
+  return dma_mem(pDest, NULL, bVal,
+                 DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_INC_gc,
+                 wLen, pCallback, pCtx);
+}
+
+
+// common interrupt handler - clears the flags, frees 'auto free' channels, and calls the callback
+static void dma_isr(uint8_t bChannel)
+{
+DMA_CH_t *pCH = dmaChannel(bChannel);
+dmaCallback pCallback = dma_info[bChannel].pCallback;
+void *pCtx = dma_info[bChannel].pCtx;
+uint8_t bStatus;
+
+  bStatus = (pCH->CTRLB & DMA_CH_ERRIF_bm) ? DMA_STATUS_ERROR : DMA_STATUS_COMPLETE;
+
+  pCH->CTRLB |= DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm; // write 1 to clear
+
+  if(dma_info[bChannel].bAutoFree)
+  {
+    dmaFreeChannel(bChannel);
+  }
+
+  if(pCallback)
+  {
+    pCallback(pCtx, bStatus);
+  }
+}
+
+ISR(DMA_CH0_vect)
+{
+  dma_isr(0);
+}
+
+ISR(DMA_CH1_vect)
+{
+  dma_isr(1);
+}
+
+ISR(DMA_CH2_vect)
+{
+  dma_isr(2);
+}
+
+ISR(DMA_CH3_vect)
+{
+  dma_isr(3);
+}
+
+#endif // DMA_CTRL
@@ -0,0 +1,97 @@
+/*
+  wiring_dma.h - DMA controller driver
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+
+  The xmega DMA controller has 4 channels (A manual sect 5).  A channel moves a 'block' of
+  up to 64k bytes as a series of 1, 2, 4 or 8 byte 'bursts'.  Each burst (or, optionally, the
+  whole block) is started by a trigger, which is either a peripheral (USART, timer, ADC, SPI,
+  event channel) or a software request.  Blocks can repeat a number of times, or forever.
+
+  Channels 0+1 and 2+3 can be paired into a double buffer, where the hardware enables the
+  other channel of the pair the moment one finishes.  The completion callback can then
+  refill the buffer of the channel that just finished, with no gap in the data stream.
+
+  Typical use:
+
+    int8_t ch = dmaAllocChannel();
+    DMA_SETUP setup = { src, dest, len, addrctrl, trigger, DMA_CH_BURSTLEN_1BYTE_gc, 1, DMA_SINGLE };
+    dmaSetup(ch, &setup);
+    dmaSetCallback(ch, my_callback, my_context);
+    dmaStart(ch);
+*/
+
+#ifndef _WIRING_DMA_H_
+#define _WIRING_DMA_H_
+
+#include <inttypes.h>
+#include <avr/io.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define DMA_NUM_CHANNELS 4
+
+// 'bFlags' in DMA_SETUP
+#define DMA_SINGLE 1    /* one burst per trigger - otherwise one trigger moves the whole block */
+
+// 'bStatus' for the callback
+#define DMA_STATUS_COMPLETE 0
+#define DMA_STATUS_ERROR    1
+
+typedef void (*dmaCallback)(void *pCtx, uint8_t bStatus);
+
+typedef struct _DMA_SETUP_
+{
+  const volatile void *pSrc;  // source address (SRAM or I/O)
+  volatile void *pDest;       // destination address (SRAM or I/O)
+  uint16_t wCount;            // block size in bytes, 0 is 64k (sect 5.15.7)
+  uint8_t bAddrCtrl;          // DMA_CH_SRCRELOAD_xx | DMA_CH_SRCDIR_xx | DMA_CH_DESTRELOAD_xx | DMA_CH_DESTDIR_xx
+  uint8_t bTrigger;           // DMA_CH_TRIGSRC_xx_gc, DMA_CH_TRIGSRC_OFF_gc for software only
+  uint8_t bBurst;             // DMA_CH_BURSTLEN_xx_gc
+  uint8_t bRepeat;            // number of blocks, 0 for 'forever', 1 for a single block
+  uint8_t bFlags;             // DMA_SINGLE
+} DMA_SETUP;
+
+int8_t dmaAllocChannel(void);   // returns -1 if all channels are in use
+int8_t dmaAllocPair(void);      // 2 channels for double buffer (returns 0 or 2), -1 if none available
+void dmaFreeChannel(uint8_t bChannel); // stops it first
+
+DMA_CH_t *dmaChannel(uint8_t bChannel); // direct register access
+
+void dmaSetup(uint8_t bChannel, const DMA_SETUP *pSetup);
+void dmaSetCallback(uint8_t bChannel, dmaCallback pCallback, void *pCtx); // runs in the ISR
+void dmaStart(uint8_t bChannel);    // enable, plus a software trigger when there is no trigger source
+void dmaTrigger(uint8_t bChannel);  // software transfer request
+void dmaStop(uint8_t bChannel);
+uint8_t dmaBusy(uint8_t bChannel);
+uint16_t dmaRemaining(uint8_t bChannel); // bytes left in the current block
+
+// double buffer - both channels of the pair must have been set up with 'dmaSetup'
+void dmaDoubleBuffer(uint8_t bFirstChannel, uint8_t bEnable);
+
+// background copy/fill in SRAM.  The channel is freed after completion, then 'pCallback'
+// is called (it can be NULL).  Returns the channel, or -1 if none is available
+int8_t dmaMemcpy(void *pDest, const void *pSrc, uint16_t wLen, dmaCallback pCallback, void *pCtx);
+int8_t dmaMemset(void *pDest, uint8_t bVal, uint16_t wLen, dmaCallback pCallback, void *pCtx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // _WIRING_DMA_H_
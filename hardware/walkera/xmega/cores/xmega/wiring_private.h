@@ -116,6 +116,10 @@ extern "C"{
 
 typedef void (*voidFuncPtr)(void);
 
+void turnOffPWM16(uint8_t pin); // implemented in wiring_analog.c - disables 16-bit PWM output on a pin
+uint8_t clock_setup_per4(void); // implemented in wiring.c - 'clkPER4' at 4 times F_CPU, for HIRES
+void turnOffSoftPWM(uint8_t pin); // implemented in wiring_softpwm.c - removes a pin from software PWM
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
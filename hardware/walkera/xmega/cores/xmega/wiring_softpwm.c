@@ -0,0 +1,273 @@
+/*
+  wiring_softpwm.c - DMA-driven software PWM for pins without a timer output
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General
+  Public License along with this library; if not, write to the
+  Free Software Foundation, Inc., 59 Temple Place, Suite 330,
+  Boston, MA  02111-1307  USA
+
+  How it works:
+
+  A table with one entry per PWM step holds 2 bytes, a 'set' mask and a 'clear' mask.  A timer
+  overflow triggers a DMA burst for every step, which writes the 2 bytes into PORTx.OUTSET and
+  PORTx.OUTCLR (they are next to each other, see A manual sect 13.13).  Only the pins in the masks
+  change, so the other pins on the port (serial, SPI, etc.) are not affected.  The DMA channel
+  repeats the table forever, so there is NO CPU involvement at all once it is running.
+
+  Every PWM pin is 'set' at step 0, and 'cleared' at the step that matches its duty cycle.  A
+  100% pin is never cleared, and a 0% pin is not in any mask at all (it is simply LOW), so it
+  never sees a short pulse.  Changing the duty cycle only moves one bit in the 'clear' masks.
+
+  Only one port at a time can have software PWM.  The timer is TCE0 by default, since the PORTE
+  pins have no PWM assigned to them.  'tone()', SoftwareSerial and 'Serial.beginAuto()' use TCE0
+  as well, so each of them (including this) claims it with 'timerClaim()' and refuses to start
+  while another one has it.  'init()' starts TCE0 regardless, so a running timer means nothing.
+  Define SOFTPWM_TIMER and SOFTPWM_TRIGGER in 'pins_arduino.h' to use a different timer (it
+  needs to be a TC0_t).  The DMA channel comes from 'dmaAllocChannel()'.
+
+  'softPWMBegin(&PORTD, 64, 200)' gives 64 steps at 200Hz on PORTD, then 'analogWrite()' on
+  any PORTD pin uses software PWM.
+*/
+
+#include "wiring_private.h"
+#include "pins_arduino.h"
+
+#ifndef SOFTPWM_TIMER
+#define SOFTPWM_TIMER TCE0
+#define SOFTPWM_TRIGGER DMA_CH_TRIGSRC_TCE0_OVF_gc
+#endif // SOFTPWM_TIMER
+
+
+typedef struct _SOFTPWM_STEP_
+{
+  uint8_t set;    // written to OUTSET
+  uint8_t clr;    // written to OUTCLR
+} SOFTPWM_STEP;
+
+static PORT_t *softpwm_port = NULL;
+static SOFTPWM_STEP *softpwm_table = NULL;
+static uint8_t softpwm_steps = 0;
+static int8_t softpwm_dma = -1;     // DMA channel
+static uint8_t softpwm_pins = 0;    // pins that 'softPWMWrite()' has assigned
+static uint8_t softpwm_duty[8];    // current 'clear' step for each bit, 'softpwm_steps' if never cleared
+                                   // and 0 for a 0% pin (which is not 'set' either)
+
+
+// get the bit number (0-7) for a pin on the software PWM port, or 0xff if it's not on that port
+static uint8_t softpwm_bit(uint8_t pin)
+{
+uint8_t port = digitalPinToPort(pin);
+
+  if(!softpwm_port || port == NOT_A_PIN
+     || portModeRegister(port) != &(softpwm_port->DIR))
+  {
+    return 0xff;
+  }
+
+  return pinBitValueToIndex(digitalPinToBitMask(pin));
+}
+
+uint8_t softPWMBegin(PORT_t *port, uint8_t steps, unsigned long frequency)
+{
+unsigned long ulPer;
+DMA_SETUP setup;
+
+  softPWMEnd(); // in case it was already running
+
+  if(steps < 2 || !frequency)
+  {
+    return 0;
+  }
+
+  ulPer = F_CPU / (frequency * steps);
+
+  if(ulPer < 16 || ulPer > 65536UL) // DMA needs a few cycles per burst, and PER is 16 bits
+  {
+    return 0;
+  }
+
+  if(!timerClaim(&SOFTPWM_TIMER, TIMER_OWNER_SOFTPWM)) // timer in use ('tone()', SoftwareSerial, etc.)
+  {
+    return 0;
+  }
+
+  softpwm_dma = dmaAllocChannel();
+
+  if(softpwm_dma < 0)
+  {
+    timerRelease(&SOFTPWM_TIMER, TIMER_OWNER_SOFTPWM);
+
+    return 0;
+  }
+
+  softpwm_table = (SOFTPWM_STEP *)malloc(steps * sizeof(SOFTPWM_STEP));
+
+  if(!softpwm_table)
+  {
+    dmaFreeChannel(softpwm_dma);
+    softpwm_dma = -1;
+
+    timerRelease(&SOFTPWM_TIMER, TIMER_OWNER_SOFTPWM);
+
+    return 0;
+  }
+
+  memset(softpwm_table, 0, steps * sizeof(SOFTPWM_STEP));
+  memset(softpwm_duty, steps, sizeof(softpwm_duty)); // nothing assigned to 'clear'
+
+  softpwm_pins = 0;
+  softpwm_port = port;
+  softpwm_steps = steps;
+
+  // pacing timer - normal mode, overflow every step
+
+  SOFTPWM_TIMER.CTRLA = 0;
+  SOFTPWM_TIMER.CTRLFSET = TC_CMD_RESET_gc;
+  SOFTPWM_TIMER.CTRLB = TC_WGMODE_NORMAL_gc; // no compare outputs
+  SOFTPWM_TIMER.PER = (uint16_t)(ulPer - 1);
+
+  // DMA channel - one 2-byte burst per trigger into OUTSET, OUTCLR.  The destination reloads
+  // after every burst, the source after every block (the whole table), and it repeats forever.
+  // See A manual sect 5.
+
+  setup.pSrc = softpwm_table;
+  setup.pDest = &(port->OUTSET);
+  setup.wCount = steps * sizeof(SOFTPWM_STEP);
+  setup.bAddrCtrl = DMA_CH_SRCRELOAD_BLOCK_gc | DMA_CH_SRCDIR_INC_gc
+                  | DMA_CH_DESTRELOAD_BURST_gc | DMA_CH_DESTDIR_INC_gc;
+  setup.bTrigger = SOFTPWM_TRIGGER;
+  setup.bBurst = DMA_CH_BURSTLEN_2BYTE_gc;
+  setup.bRepeat = 0; // forever
+  setup.bFlags = DMA_SINGLE;
+
+  dmaSetup(softpwm_dma, &setup);
+  dmaStart(softpwm_dma);
+
+  SOFTPWM_TIMER.CTRLA = TC_CLKSEL_DIV1_gc; // go
+
+  return 1;
+}
+
+void softPWMEnd(void)
+{
+  if(!softpwm_port)
+  {
+    return;
+  }
+
+  SOFTPWM_TIMER.CTRLA = 0;
+  SOFTPWM_TIMER.CTRLFSET = TC_CMD_RESET_gc;
+
+  dmaFreeChannel(softpwm_dma); // waits for the last burst
+  softpwm_dma = -1;
+
+  timerRelease(&SOFTPWM_TIMER, TIMER_OWNER_SOFTPWM);
+
+  // all software PWM pins LOW
+  softpwm_port->OUTCLR = softpwm_pins;
+
+  free(softpwm_table);
+
+  softpwm_table = NULL;
+  softpwm_pins = 0;
+  softpwm_port = NULL;
+  softpwm_steps = 0;
+}
+
+uint8_t softPWMWrite(uint8_t pin, uint8_t val)
+{
+uint8_t bit, mask, duty, old;
+
+  bit = softpwm_bit(pin);
+
+  if(bit > 7)
+  {
+    return 0; // not mine
+  }
+
+  mask = _BV(bit);
+  duty = (uint8_t)(((uint16_t)val * softpwm_steps + 127) / 255);
+
+  if(!(softpwm_pins & mask)) // new pin - it starts out as a 0% pin
+  {
+    softpwm_port->OUTCLR = mask;
+    softpwm_port->DIRSET = mask;
+
+    softpwm_pins |= mask;
+    softpwm_duty[bit] = 0;
+  }
+
+  old = softpwm_duty[bit];
+
+  if(duty == old)
+  {
+    return 1;
+  }
+
+  // the DMA reads the table all of the time, but byte writes are atomic.  The new 'clear' goes in
+  // before the old one is removed, so the worst case is ONE period that ends at the earlier step.
+
+  if(!duty) // 0% - out of the 'set' mask FIRST, then it can be forced LOW for good
+  {
+    softpwm_table[0].set &= ~mask;
+    softpwm_port->OUTCLR = mask;
+  }
+  else if(duty < softpwm_steps)
+  {
+    softpwm_table[duty].clr |= mask;
+  }
+
+  if(old && old < softpwm_steps)
+  {
+    softpwm_table[old].clr &= ~mask;
+  }
+
+  if(duty && !old) // it was 0%, its 'clear' is already in place, so now it can be 'set'
+  {
+    softpwm_table[0].set |= mask;
+  }
+
+  softpwm_duty[bit] = duty;
+
+  return 1;
+}
+
+void turnOffSoftPWM(uint8_t pin)
+{
+uint8_t bit, mask;
+
+  bit = softpwm_bit(pin);
+
+  if(bit > 7)
+  {
+    return;
+  }
+
+  mask = _BV(bit);
+
+  if(!(softpwm_pins & mask))
+  {
+    return;
+  }
+
+  softpwm_table[0].set &= ~mask; // no longer 'set', then remove the 'clear'
+
+  if(softpwm_duty[bit] && softpwm_duty[bit] < softpwm_steps)
+  {
+    softpwm_table[softpwm_duty[bit]].clr &= ~mask;
+  }
+
+  softpwm_duty[bit] = softpwm_steps;
+  softpwm_pins &= ~mask;
+}
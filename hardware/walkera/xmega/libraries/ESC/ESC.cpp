@@ -0,0 +1,391 @@
+/*
+  ESC.cpp - ESC (motor speed controller) output library for XMEGA
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "ESC.h"
+
+ESCClass ESC;
+
+// How the 'oneshot' protocols work:
+//
+// The timers run single-slope PWM with a period slightly longer than the longest pulse, and all
+// of the compare values at zero (output always LOW).  'update()' writes the pulse widths into the
+// CCxBUF registers and then sets CNT to PER, so the counter reaches BOTTOM on the very next clock.
+// That is an UPDATE condition (A manual sect 14.7), so the buffers are copied into CCx and the
+// outputs go HIGH at once.  The overflow interrupt that goes with it puts zeros back into the
+// CCxBUF registers, which the next UPDATE loads after the pulse has ended.  So, exactly ONE pulse
+// per 'update()'.  A 2nd overflow interrupt marks the end of the frame, and disables itself.
+
+typedef struct _ESC_PROTOCOL_
+{
+  uint16_t minUs;   // pulse width for zero throttle (microseconds, or 1/8 us for multishot)
+  uint16_t maxUs;   // pulse width for full throttle
+  uint8_t clksel;   // timer clock
+  uint8_t div;      // pre-scaler that goes with 'clksel'
+} ESC_PROTOCOL;
+
+#define MULTISHOT_SCALE 8 /* multishot times are in 1/8 us so 5-25us is 40-200 */
+
+static const ESC_PROTOCOL aProtocol[] PROGMEM =
+{
+  { 1000, 2000, TC_CLKSEL_DIV8_gc, 8 }, // ESC_PWM
+  { 125, 250, TC_CLKSEL_DIV1_gc, 1 },   // ESC_ONESHOT125
+  { 42, 84, TC_CLKSEL_DIV1_gc, 1 },     // ESC_ONESHOT42
+  { 5 * MULTISHOT_SCALE, 25 * MULTISHOT_SCALE, TC_CLKSEL_DIV1_gc, 1 } // ESC_MULTISHOT
+};
+
+ESCClass::ESCClass()
+{
+  _numChannels = 0;
+  _numTimers = 0;
+  _protocol = ESC_PWM;
+  _clksel = 0;
+  _hiRes = false;
+}
+
+bool ESCClass::begin(uint8_t protocol, uint16_t pwmRate, bool hiRes)
+{
+unsigned long ulTickRate;
+uint16_t wMin, wMax;
+uint8_t bDiv;
+
+  if(protocol > ESC_MULTISHOT || (hiRes && protocol == ESC_PWM))
+  {
+    return false;
+  }
+
+  end(); // in case it was already running
+
+  wMin = pgm_read_word(&aProtocol[protocol].minUs);
+  wMax = pgm_read_word(&aProtocol[protocol].maxUs);
+  _clksel = pgm_read_byte(&aProtocol[protocol].clksel);
+  bDiv = pgm_read_byte(&aProtocol[protocol].div);
+
+  if(protocol == ESC_PWM)
+  {
+    if(pwmRate < ESC_PWM_RATE_MIN)
+    {
+      pwmRate = ESC_PWM_RATE_MIN;
+    }
+    else if(pwmRate > ESC_PWM_RATE_MAX)
+    {
+      pwmRate = ESC_PWM_RATE_MAX;
+    }
+
+    // at 32Mhz a DIV8 frame below ~62Hz does not fit into 16 bits, so use the next pre-scaler
+    if((F_CPU / bDiv) / pwmRate > 0x10000UL)
+    {
+      _clksel = TC_CLKSEL_DIV64_gc;
+      bDiv = 64;
+    }
+  }
+
+  ulTickRate = F_CPU / bDiv;
+
+  if(hiRes)
+  {
+    ulTickRate *= 4; // Hi-Res - the compare units count in 1/4 peripheral clock
+  }
+
+  if(protocol == ESC_MULTISHOT)
+  {
+    ulTickRate /= MULTISHOT_SCALE; // so that the '1/8 us' values convert correctly
+  }
+
+  // ticks per microsecond is an integer for all supported F_CPU values (8, 16, 32 MHz)
+  _minTicks = (uint16_t)((ulTickRate / 1000000UL) * wMin);
+  wMax = (uint16_t)((ulTickRate / 1000000UL) * wMax);
+
+  _scale = ((uint32_t)(wMax - _minTicks) << 16) / ESC_THROTTLE_MAX;
+
+  if(protocol == ESC_PWM)
+  {
+    _per = (uint16_t)((F_CPU / bDiv) / pwmRate - 1);
+  }
+  else
+  {
+    _per = wMax + (wMax >> 3); // the pulse, plus a short gap
+  }
+
+  _protocol = protocol;
+  _hiRes = hiRes;
+
+  return true;
+}
+
+void ESCClass::end(void)
+{
+uint8_t i1;
+
+  for(i1=0; i1 < _numTimers; i1++)
+  {
+    _timer[i1].port->INTCTRLA = 0;
+    _timer[i1].port->CTRLA = 0;
+    _timer[i1].port->CTRLFSET = TC_CMD_RESET_gc; // also disables the outputs
+
+    if(_hiRes)
+    {
+      timer16HiRes(_timer[i1].port, 0);
+    }
+    _timer[i1].state = 0;
+  }
+
+  for(i1=0; i1 < _numChannels; i1++)
+  {
+    digitalWrite(_channel[i1].pin, LOW);
+  }
+
+  _numChannels = 0;
+  _numTimers = 0;
+}
+
+uint8_t ESCClass::timerIndex(TC0_t *port)
+{
+uint8_t i1;
+
+  for(i1=0; i1 < _numTimers; i1++)
+  {
+    if(_timer[i1].port == port)
+    {
+      return i1;
+    }
+  }
+
+  // not found - first channel on this timer, so set it up
+
+  _timer[i1].port = port;
+  _timer[i1].maxTicks = 0;
+  _timer[i1].state = 0;
+  _numTimers++;
+
+  startTimer(port);
+
+  return i1;
+}
+
+void ESCClass::startTimer(TC0_t *port)
+{
+uint8_t oldSREG = SREG;
+
+  cli(); // 16-bit registers share the 'TEMP' register
+
+  port->CTRLA = 0;                  // timer OFF while I re-configure it
+  port->CTRLFSET = TC_CMD_RESET_gc;
+  port->CTRLB = TC_WGMODE_SS_gc;    // single slope PWM, outputs enabled by 'attach()'
+  port->CTRLD = 0;
+  port->CTRLE = 0;                  // 16-bit mode
+  port->INTCTRLA = 0;               // oneshot:  enabled by 'update()'
+  port->INTCTRLB = 0;
+  port->PER = _per;
+
+  port->CTRLA = _clksel;
+
+  SREG = oldSREG;
+}
+
+int8_t ESCClass::attach(uint8_t pin)
+{
+TC0_t *port;
+uint8_t bChannel, oldSREG;
+ESC_CHANNEL *pC;
+
+  if(_numChannels >= ESC_MAX_CHANNELS || !_clksel)
+  {
+    return -1;
+  }
+
+  port = digitalPinToTimer16(pin, &bChannel);
+
+  if(!port)
+  {
+    return -1;
+  }
+
+  if(_hiRes && !timer16HiRes(port, 1)) // no Hi-Res for this timer - pulses would be 4 times as long
+  {
+    return -1;
+  }
+
+  pC = &(_channel[_numChannels]);
+
+  pC->pin = pin;
+  pC->timerIndex = timerIndex(port);
+  pC->pCCBuf = &(port->CCABUF) + bChannel; // TC1_t has CCABUF and CCBBUF in the same place
+  pC->ticks = _minTicks;
+
+  oldSREG = SREG;
+  cli();
+
+  (&(port->CCA))[bChannel] = _protocol == ESC_PWM ? _minTicks : 0; // PWM - ESCs arm on min throttle
+  *(pC->pCCBuf) = _protocol == ESC_PWM ? _minTicks : 0;
+
+  SREG = oldSREG;
+
+  digitalWrite(pin, LOW);
+  pinMode(pin, OUTPUT);
+
+  port->CTRLB |= (TC0_CCAEN_bm << bChannel);
+
+  return _numChannels++;
+}
+
+void ESCClass::write(uint8_t channel, uint16_t throttle)
+{
+ESC_CHANNEL *pC;
+uint16_t wTicks;
+uint8_t oldSREG;
+
+  if(channel >= _numChannels)
+  {
+    return;
+  }
+
+  if(throttle > ESC_THROTTLE_MAX)
+  {
+    throttle = ESC_THROTTLE_MAX;
+  }
+
+  pC = &(_channel[channel]);
+
+  wTicks = _minTicks + (uint16_t)(((uint32_t)throttle * _scale) >> 16);
+  pC->ticks = wTicks;
+
+  if(_protocol == ESC_PWM) // free running - goes out with the next frame
+  {
+    oldSREG = SREG;
+    cli();
+
+    *(pC->pCCBuf) = wTicks;
+
+    SREG = oldSREG;
+  }
+}
+
+void ESCClass::writeAll(uint16_t throttle)
+{
+uint8_t i1;
+
+  for(i1=0; i1 < _numChannels; i1++)
+  {
+    write(i1, throttle);
+  }
+}
+
+void ESCClass::update(void)
+{
+uint8_t i1, oldSREG;
+ESC_TIMER *pT;
+
+  if(_protocol == ESC_PWM)
+  {
+    return;
+  }
+
+  // wait for the previous frame to end, so no ESC ever sees a shortened pulse.
+  // this is at most the period of one frame, i.e. 'max pulse + 1/8'.  The frame ends in the
+  // overflow interrupt, so with interrupts off (or inside an ISR) this frame is skipped instead
+
+  for(i1=0; i1 < _numTimers; i1++)
+  {
+    while(_timer[i1].state)
+    {
+      if(!(SREG & CPU_I_bm))
+      {
+        return;
+      }
+    }
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  for(i1=0; i1 < _numChannels; i1++)
+  {
+    *(_channel[i1].pCCBuf) = _channel[i1].ticks;
+  }
+
+  for(i1=0; i1 < _numTimers; i1++)
+  {
+    pT = &(_timer[i1]);
+
+    pT->state = 1;
+    pT->port->INTFLAGS = TC0_OVFIF_bm;         // clear any old overflow
+    pT->port->INTCTRLA = TC_OVFINTLVL_HI_gc;   // so the buffers are zeroed before the next frame
+    pT->port->CNT = _hiRes ? (_per & ~3) : _per; // BOTTOM on the next clock, and the pulse starts
+                                                 // (Hi-Res counts by 4, the 2 LSBs are not used)
+  }
+
+  SREG = oldSREG;
+}
+
+void ESCClass::timerOverflow(TC0_t *port)
+{
+uint8_t i1, bIndex;
+
+  for(bIndex=0; bIndex < _numTimers; bIndex++)
+  {
+    if(_timer[bIndex].port == port)
+    {
+      break;
+    }
+  }
+
+  if(bIndex >= _numTimers)
+  {
+    port->INTCTRLA = 0; // not mine
+    return;
+  }
+
+  if(_timer[bIndex].state == 1) // the pulse just started
+  {
+    for(i1=0; i1 < _numChannels; i1++)
+    {
+      if(_channel[i1].timerIndex == bIndex)
+      {
+        *(_channel[i1].pCCBuf) = 0; // no pulse on the next UPDATE
+      }
+    }
+
+    _timer[bIndex].state = 2;
+  }
+  else // the frame is over
+  {
+    port->INTCTRLA = 0;
+    _timer[bIndex].state = 0;
+  }
+}
+
+
+ISR(TCC0_OVF_vect)
+{
+  ESC.timerOverflow(&TCC0);
+}
+
+#ifdef TCC1
+ISR(TCC1_OVF_vect)
+{
+  ESC.timerOverflow((TC0_t *)&TCC1);
+}
+#endif // TCC1
+
+#ifdef TCD1
+ISR(TCD1_OVF_vect)
+{
+  ESC.timerOverflow((TC0_t *)&TCD1);
+}
+#endif // TCD1
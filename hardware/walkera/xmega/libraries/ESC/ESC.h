@@ -0,0 +1,129 @@
+/*
+  ESC.h - ESC (motor speed controller) output library for XMEGA
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+  Drives up to 8 ESC channels from the 16-bit timer compare units that
+  'analogWrite16()' uses:  TCC0 (PC0-PC3), TCC1 (PC4-PC5) and TCD1 (PD4-PD5).
+  TCD0 is not available, since it runs 'millis()'.
+
+  Protocols:
+    ESC_PWM          1000-2000us pulses, free running at 50-490Hz
+    ESC_ONESHOT125   125-250us pulses
+    ESC_ONESHOT42    42-84us pulses
+    ESC_MULTISHOT    5-25us pulses
+
+  With ESC_PWM the timers run freely and a new value goes out with the next
+  frame.  With the 'oneshot' protocols exactly one pulse is generated for each
+  call to 'update()', and it starts on the next timer clock, so the latency
+  from the control loop to the motors is as short as it can be.
+
+  With 'hiRes' the timer Hi-Res extension gives 4 times the resolution (e.g. 8000
+  steps for OneShot125 at 16Mhz) so that ESC_THROTTLE_MAX is fully used.
+
+  Usage:
+    ESC.begin(ESC_ONESHOT125);
+    ESC.attach(8); ESC.attach(9); ESC.attach(10); ESC.attach(11);
+    ...
+    ESC.write(0, throttle0); // 0 to ESC_THROTTLE_MAX
+    ...
+    ESC.update();            // start the pulses for all channels at once
+
+  The timers used by attached pins belong to this library until 'end()'.
+*/
+
+#ifndef _ESC_H_INCLUDED
+#define _ESC_H_INCLUDED
+
+#include <Arduino.h>
+
+#define ESC_PWM 0
+#define ESC_ONESHOT125 1
+#define ESC_ONESHOT42 2
+#define ESC_MULTISHOT 3
+
+#define ESC_MAX_CHANNELS 8
+#define ESC_MAX_TIMERS 3
+
+#define ESC_THROTTLE_MAX 2000 /* 'write()' values go from 0 (minimum pulse) to this (maximum pulse) */
+
+#define ESC_PWM_RATE_MIN 50
+#define ESC_PWM_RATE_MAX 490
+
+class ESCClass
+{
+public:
+  ESCClass();
+
+  // 'pwmRate' is only used with ESC_PWM, and is limited to 50-490Hz
+  // 'hiRes' uses the timer Hi-Res extension for 4 times the pulse resolution.  It is only
+  // possible with the 'oneshot' protocols, since the period is limited to appx 1ms.
+  // returns 'false' for an unknown protocol, or 'hiRes' with ESC_PWM
+  bool begin(uint8_t protocol, uint16_t pwmRate = ESC_PWM_RATE_MAX, bool hiRes = false);
+  void end(void);
+
+  // returns the channel number, or -1 if the pin has no 16-bit timer or all channels are used
+  int8_t attach(uint8_t pin);
+
+  void write(uint8_t channel, uint16_t throttle);
+  void writeAll(uint16_t throttle);
+
+  // start the pulses ('oneshot' protocols).  With ESC_PWM it does nothing, since the new
+  // values are picked up at the start of the next frame anyway.  With interrupts disabled it
+  // does not wait for a frame that is still running, that call is simply skipped
+  void update(void);
+
+  inline uint8_t protocol(void) { return _protocol; }
+  inline uint8_t channels(void) { return _numChannels; }
+  inline uint16_t resolution(void) { return (uint16_t)((_scale * ESC_THROTTLE_MAX) >> 16); } // timer ticks from min to max
+
+  // called by the timer overflow interrupts - not for use by sketches
+  void timerOverflow(TC0_t *port);
+
+protected:
+  typedef struct _ESC_CHANNEL_
+  {
+    uint8_t pin;
+    uint8_t timerIndex;
+    volatile uint16_t *pCCBuf;   // the CCxBUF register for this channel
+    uint16_t ticks;              // current pulse width in timer ticks
+  } ESC_CHANNEL;
+
+  typedef struct _ESC_TIMER_
+  {
+    TC0_t *port;                 // TC1_t timers are accessed as TC0_t (same register layout)
+    uint16_t maxTicks;           // the longest pulse assigned in the last 'update()'
+    volatile uint8_t state;      // oneshot:  0=idle, 1=pulse running
+  } ESC_TIMER;
+
+  ESC_CHANNEL _channel[ESC_MAX_CHANNELS];
+  ESC_TIMER _timer[ESC_MAX_TIMERS];
+  uint8_t _numChannels;
+  uint8_t _numTimers;
+  uint8_t _protocol;
+  bool _hiRes;
+  uint8_t _clksel;               // CTRLA clock select for the protocol
+  uint16_t _per;                 // PER for the protocol
+  uint16_t _minTicks;            // pulse width for a throttle of 0
+  uint32_t _scale;               // (max - min ticks) * 65536 / ESC_THROTTLE_MAX
+
+  uint8_t timerIndex(TC0_t *port);
+  void startTimer(TC0_t *port);
+};
+
+extern ESCClass ESC;
+
+#endif // _ESC_H_INCLUDED
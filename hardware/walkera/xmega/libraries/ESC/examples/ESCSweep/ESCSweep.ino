@@ -0,0 +1,46 @@
+/*
+  ESC Sweep
+
+  Drives 4 ESCs with OneShot125 pulses from pins 8-11 (PC0-PC3, timer TCC0),
+  slowly ramping the throttle up and down.  A new pulse goes out every time
+  the loop calls 'ESC.update()'.
+
+  REMOVE THE PROPELLERS before running this!
+*/
+
+#include <ESC.h>
+
+uint16_t throttle = 0;
+int16_t step = 1;
+
+void setup()
+{
+  ESC.begin(ESC_ONESHOT125);
+
+  ESC.attach(8);
+  ESC.attach(9);
+  ESC.attach(10);
+  ESC.attach(11);
+
+  // ESCs arm on a few seconds of minimum throttle
+  for(uint16_t i = 0; i < 2000; i++)
+  {
+    ESC.update();
+    delay(1);
+  }
+}
+
+void loop()
+{
+  throttle += step;
+
+  if(throttle == 0 || throttle >= ESC_THROTTLE_MAX / 4)
+  {
+    step = -step;
+  }
+
+  ESC.writeAll(throttle);
+  ESC.update();
+
+  delay(2); // stands in for the control loop
+}
@@ -0,0 +1,526 @@
+/*
+  Framing.cpp - COBS and SLIP packet framing for any Stream
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Framing.h"
+#include <util/crc16.h>
+
+#define FRAMING_CRC_INIT 0xffff
+
+// CRC16-CCITT, polynomial 1021H, MSB first.  With the CRC appended MSB first, the CRC over
+// the whole packet is zero, so the decoder doesn't need to know where the data ends.
+#define FRAMING_CRC(crc, c) _crc_xmodem_update(crc, c)
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encoder
+//////////////////////////////////////////////////////////////////////////////
+
+FrameEncoder::FrameEncoder()
+{
+  _out = NULL;
+  _protocol = FRAMING_COBS;
+  _crc_on = false;
+  _open = false;
+  _crc = FRAMING_CRC_INIT;
+  _blen = 0;
+  _block = NULL;
+}
+
+bool FrameEncoder::begin(Print &out, uint8_t protocol, bool crc, uint8_t *block)
+{
+  _open = false;
+  _blen = 0;
+
+  if(protocol == FRAMING_COBS && !block)
+  {
+    _out = NULL; // 'write()' does nothing
+
+    return false;
+  }
+
+  _out = &out;
+  _protocol = protocol;
+  _crc_on = crc;
+  _block = block;
+
+  return true;
+}
+
+void FrameEncoder::open(void)
+{
+  _open = true;
+  _crc = FRAMING_CRC_INIT;
+  _blen = 0;
+
+  if(_protocol == FRAMING_SLIP)
+  {
+    _out->write((uint8_t)SLIP_END); // ends any noise the receiver saw before this packet
+  }
+}
+
+// COBS - the code byte, then the block.  A code below FFH means a zero follows the block
+void FrameEncoder::cobs_flush(uint8_t code)
+{
+  _out->write(code);
+
+  if(_blen)
+  {
+    _out->write(_block, _blen);
+  }
+
+  _blen = 0;
+}
+
+void FrameEncoder::put(uint8_t c)
+{
+  if(_protocol == FRAMING_SLIP)
+  {
+    if(c == SLIP_END)
+    {
+      _out->write((uint8_t)SLIP_ESC);
+      _out->write((uint8_t)SLIP_ESC_END);
+    }
+    else if(c == SLIP_ESC)
+    {
+      _out->write((uint8_t)SLIP_ESC);
+      _out->write((uint8_t)SLIP_ESC_ESC);
+    }
+    else
+    {
+      _out->write(c);
+    }
+
+    return;
+  }
+
+  if(!c)
+  {
+    cobs_flush(_blen + 1);
+  }
+  else
+  {
+    _block[_blen++] = c;
+
+    if(_blen == FRAMING_COBS_BLOCK)
+    {
+      cobs_flush(0xff);
+    }
+  }
+}
+
+size_t FrameEncoder::write(uint8_t c)
+{
+  if(!_out)
+  {
+    return 0;
+  }
+
+  if(!_open)
+  {
+    open();
+  }
+
+  if(_crc_on)
+  {
+    _crc = FRAMING_CRC(_crc, c);
+  }
+
+  put(c);
+
+  return 1;
+}
+
+size_t FrameEncoder::write(const uint8_t *buffer, size_t size)
+{
+size_t i1, iRun, iMax;
+
+  if(!_out)
+  {
+    return 0;
+  }
+
+  if(_protocol == FRAMING_SLIP) // nothing to gain from looking ahead
+  {
+    for(i1=0; i1 < size; i1++)
+    {
+      write(buffer[i1]);
+    }
+
+    return size;
+  }
+
+  if(!_open)
+  {
+    open();
+  }
+
+  if(_crc_on)
+  {
+    for(i1=0; i1 < size; i1++)
+    {
+      _crc = FRAMING_CRC(_crc, buffer[i1]);
+    }
+  }
+
+  i1 = 0;
+
+  while(i1 < size)
+  {
+    if(_blen) // finish the block that was started one byte at a time
+    {
+      put(buffer[i1++]);
+
+      continue;
+    }
+
+    // a whole block straight from 'buffer', if it ends with a zero or is the longest there is
+    iMax = size - i1;
+
+    if(iMax > FRAMING_COBS_BLOCK)
+    {
+      iMax = FRAMING_COBS_BLOCK;
+    }
+
+    for(iRun=0; iRun < iMax && buffer[i1 + iRun]; iRun++) { }
+
+    if(iRun < iMax) // a zero ends it
+    {
+      _out->write((uint8_t)(iRun + 1));
+      _out->write(buffer + i1, iRun);
+
+      i1 += iRun + 1;
+    }
+    else if(iRun == FRAMING_COBS_BLOCK)
+    {
+      _out->write((uint8_t)0xff);
+      _out->write(buffer + i1, iRun);
+
+      i1 += iRun;
+    }
+    else // the rest of 'buffer', and I don't know what comes next
+    {
+      memcpy(_block, buffer + i1, iRun);
+      _blen = iRun;
+
+      i1 += iRun;
+    }
+  }
+
+  return size;
+}
+
+void FrameEncoder::end(void)
+{
+uint16_t wCRC;
+
+  if(!_out)
+  {
+    return;
+  }
+
+  if(!_open)
+  {
+    open();
+  }
+
+  if(_crc_on)
+  {
+    wCRC = _crc;
+
+    put((uint8_t)(wCRC >> 8));
+    put((uint8_t)wCRC);
+  }
+
+  if(_protocol == FRAMING_SLIP)
+  {
+    _out->write((uint8_t)SLIP_END);
+  }
+  else
+  {
+    cobs_flush(_blen + 1); // the last block has no zero after it
+    _out->write((uint8_t)0);
+  }
+
+  _open = false;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Decoder
+//////////////////////////////////////////////////////////////////////////////
+
+FrameDecoder::FrameDecoder()
+{
+  _buf = NULL;
+  _size = 0;
+  _len = 0;
+  _protocol = FRAMING_COBS;
+  _crc_on = false;
+  _crc = FRAMING_CRC_INIT;
+  _code = 0;
+  _last = 0;
+  _discard = 1;
+  _ready = 0;
+  _errors = 0;
+}
+
+void FrameDecoder::begin(uint8_t *buffer, unsigned int size, uint8_t protocol, bool crc)
+{
+uint8_t oldSREG = SREG;
+
+  cli(); // 'feed()' might be running in an ISR already
+
+  _buf = buffer;
+  _size = size;
+  _protocol = protocol;
+  _crc_on = crc;
+  _len = 0;
+  _crc = FRAMING_CRC_INIT;
+  _code = 0;
+  _last = 0;
+  _ready = 0;
+  _errors = 0;
+
+  // whatever is on the line now might be the middle of a packet
+  _discard = 1;
+
+  SREG = oldSREG;
+}
+
+// the next decoded byte.  returns 'false' if it doesn't fit
+bool FrameDecoder::put(uint8_t c)
+{
+  if(_len >= _size)
+  {
+    return false;
+  }
+
+  _buf[_len++] = c;
+  _crc = FRAMING_CRC(_crc, c);
+
+  return true;
+}
+
+// bad packet - count it, and wait for the next delimiter
+void FrameDecoder::fail(void)
+{
+  _errors++;
+  _discard = 1;
+}
+
+// delimiter - returns 'true' for a good packet
+bool FrameDecoder::done(void)
+{
+bool bRval = false;
+
+  if(_discard) // the end of a bad one (or of whatever came before 'begin()')
+  {
+    _discard = 0;
+  }
+  else if(_len) // empty packets (e.g. 2 delimiters in a row) are ignored
+  {
+    if(_protocol == FRAMING_COBS && _code) // the last block is short
+    {
+      _errors++;
+    }
+    else if(_crc_on && (_len < 2 || _crc)) // the CRC over data + CRC is zero
+    {
+      _errors++;
+    }
+    else
+    {
+      if(_crc_on)
+      {
+        _len -= 2;
+      }
+
+      _ready = 1;
+      bRval = true;
+    }
+  }
+
+  // start over
+  if(!bRval)
+  {
+    _len = 0;
+  }
+
+  _crc = FRAMING_CRC_INIT;
+  _code = 0;
+  _last = 0;
+
+  return bRval;
+}
+
+bool FrameDecoder::feed(uint8_t c)
+{
+  if(!_buf)
+  {
+    return false;
+  }
+
+  if(_ready) // the last packet is still in the buffer, so this one is lost
+  {
+    if(c != (_protocol == FRAMING_SLIP ? SLIP_END : 0))
+    {
+      _discard = 1;
+    }
+    else if(_discard) // its end - the next one can be received after 'release()'
+    {
+      _errors++;
+      _discard = 0;
+    }
+
+    return false;
+  }
+
+  if(_protocol == FRAMING_SLIP)
+  {
+    if(c == SLIP_END)
+    {
+      return done();
+    }
+
+    if(_discard)
+    {
+      return false;
+    }
+
+    if(_last) // the byte after SLIP_ESC
+    {
+      _last = 0;
+
+      if(c == SLIP_ESC_END)
+      {
+        c = SLIP_END;
+      }
+      else if(c == SLIP_ESC_ESC)
+      {
+        c = SLIP_ESC;
+      }
+      else
+      {
+        fail();
+
+        return false;
+      }
+    }
+    else if(c == SLIP_ESC)
+    {
+      _last = 1;
+
+      return false;
+    }
+
+    if(!put(c))
+    {
+      fail();
+    }
+
+    return false;
+  }
+
+  // COBS
+  if(!c)
+  {
+    return done();
+  }
+
+  if(_discard)
+  {
+    return false;
+  }
+
+  if(!_code) // code byte - the block before it had a zero after it, unless it was a full one
+  {
+    if(_last && _last != 0xff && !put(0))
+    {
+      fail();
+
+      return false;
+    }
+
+    _last = c;
+    _code = c - 1;
+  }
+  else
+  {
+    _code--;
+
+    if(!put(c))
+    {
+      fail();
+    }
+  }
+
+  return false;
+}
+
+bool FrameDecoder::poll(Stream &in)
+{
+  while(!_ready && in.available() > 0)
+  {
+    feed((uint8_t)in.read());
+  }
+
+  return _ready;
+}
+
+void FrameDecoder::release(void)
+{
+uint8_t oldSREG = SREG;
+
+  cli();
+
+  _len = 0;
+  _ready = 0;
+
+  SREG = oldSREG;
+}
+
+unsigned long FrameDecoder::errors(void)
+{
+unsigned long ulRval;
+uint8_t oldSREG = SREG;
+
+  cli();
+  ulRval = _errors;
+  SREG = oldSREG;
+
+  return ulRval;
+}
+
+bool FrameDecoder::rxHook(void *pCtx, uint8_t c, uint8_t stat)
+{
+FrameDecoder *pD = (FrameDecoder *)pCtx;
+
+  if(stat & (_BV(USART_FERR_bp) | _BV(USART_PERR_bp))) // broken byte, so a broken packet
+  {
+    if(!pD->_ready && !pD->_discard)
+    {
+      pD->fail();
+    }
+
+    return true;
+  }
+
+  pD->feed(c);
+
+  return true;
+}
@@ -0,0 +1,151 @@
+/*
+  Framing.h - COBS and SLIP packet framing for any Stream
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+  Binary packets over a byte stream, with a delimiter that can never show up
+  inside a packet.  After a lost or broken byte, the receiver is back in sync
+  with the next delimiter.
+
+  Protocols:
+    FRAMING_COBS   Consistent Overhead Byte Stuffing - packets end with 00H, which is
+                   removed from the data at a cost of 1 byte per 254 (worst case)
+    FRAMING_SLIP   RFC 1055 - packets end with C0H, C0H and DBH in the data are escaped
+                   (2 bytes each)
+
+  With 'crc', a CRC16 (CCITT, polynomial 1021H, start FFFFH) is added to the end of
+  each packet, MSB first, and checked by the decoder.
+
+  The encoder is a 'Print', so 'print()' and 'write()' go into the current packet,
+  straight to the output.  'end()' finishes the packet.  Nothing is allocated.  COBS
+  needs to know where the next zero is before it can send a block, so the encoder
+  keeps up to 254 bytes when they come one at a time, in a FRAMING_COBS_BLOCK buffer
+  that belongs to the caller (SLIP needs none).  'write(buf, len)' sends whole blocks
+  directly from 'buf' whenever it can.
+
+  The decoder works one byte at a time into a buffer that belongs to the caller, and
+  only keeps a few bytes of state, so it can run in the RXC ISR of a HardwareSerial
+  port (see 'FrameDecoder::rxHook').  A complete packet stays in the buffer until
+  'release()', and bytes that come in meanwhile are thrown away.
+
+  Usage:
+    uint8_t block[FRAMING_COBS_BLOCK];
+    FrameEncoder enc;
+    enc.begin(Serial, FRAMING_COBS, true, block);
+    enc.write(data, len);
+    enc.end();
+
+    uint8_t buf[64];
+    FrameDecoder dec;
+    dec.begin(buf, sizeof(buf), FRAMING_COBS, true);
+    ...
+    if(dec.poll(Serial))
+    {
+      use(dec.data(), dec.length());
+      dec.release();
+    }
+*/
+
+#ifndef _FRAMING_H_INCLUDED
+#define _FRAMING_H_INCLUDED
+
+#include <Arduino.h>
+
+#define FRAMING_COBS 0
+#define FRAMING_SLIP 1
+
+#define FRAMING_COBS_BLOCK 254 /* longest COBS block (code FFH) */
+
+#define SLIP_END     0xc0
+#define SLIP_ESC     0xdb
+#define SLIP_ESC_END 0xdc
+#define SLIP_ESC_ESC 0xdd
+
+class FrameEncoder : public Print
+{
+public:
+  FrameEncoder();
+
+  // 'block' is FRAMING_COBS_BLOCK bytes for COBS, and not used for SLIP.  returns 'false'
+  // (and the encoder writes nothing) for COBS without one
+  bool begin(Print &out, uint8_t protocol, bool crc = false, uint8_t *block = NULL);
+
+  // data for the current packet - the first byte after 'end()' starts a new one
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+
+  // adds the CRC and the delimiter
+  void end(void);
+
+protected:
+  Print *_out;
+  uint8_t _protocol;
+  bool _crc_on;
+  bool _open;                           // a packet was started
+  uint16_t _crc;
+  uint8_t _blen;                        // COBS - bytes in '_block'
+  uint8_t *_block;                      // COBS - the block that waits for its code byte (caller's)
+
+  void open(void);
+  void put(uint8_t c); // one byte of the packet, after the CRC
+  void cobs_flush(uint8_t code);
+};
+
+class FrameDecoder
+{
+public:
+  FrameDecoder();
+
+  void begin(uint8_t *buffer, unsigned int size, uint8_t protocol, bool crc = false);
+
+  // one received byte - returns 'true' when it completed a packet.  ISR safe
+  bool feed(uint8_t c);
+
+  // feeds what 'in' has available, stops at the end of a packet.  returns 'available()'
+  bool poll(Stream &in);
+
+  inline bool available(void) { return _ready; }
+  inline const uint8_t *data(void) { return _buf; }
+  inline unsigned int length(void) { return _ready ? _len : 0; }
+
+  // done with the packet in the buffer, the next one can come in
+  void release(void);
+
+  unsigned long errors(void); // packets thrown away (bad encoding, too long, bad CRC, UART error, not released)
+
+  // for 'HardwareSerial::setRxHook(FrameDecoder::rxHook, &decoder)'
+  static bool rxHook(void *pCtx, uint8_t c, uint8_t stat);
+
+protected:
+  uint8_t *_buf;
+  unsigned int _size;
+  unsigned int _len;
+  uint8_t _protocol;
+  bool _crc_on;
+  uint16_t _crc;
+  uint8_t _code;             // COBS - bytes left in this block
+  uint8_t _last;             // COBS - code of the last block, 0 at the start.  SLIP - 1 after SLIP_ESC
+  uint8_t _discard;          // ignore everything until the next delimiter
+  volatile uint8_t _ready;   // a complete packet is in '_buf'
+  volatile unsigned long _errors;
+
+  bool put(uint8_t c);
+  bool done(void);
+  void fail(void);
+};
+
+#endif // _FRAMING_H_INCLUDED
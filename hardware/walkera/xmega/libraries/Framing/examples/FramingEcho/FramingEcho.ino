@@ -0,0 +1,39 @@
+/*
+  Framing Echo
+
+  Receives COBS packets with CRC16 on 'Serial2', decoded in the receive
+  interrupt, and sends each one back with the packet count in front of it.
+*/
+
+#include <Framing.h>
+
+uint8_t buf[128];
+uint8_t block[FRAMING_COBS_BLOCK]; // for the COBS encoder
+FrameDecoder dec;
+FrameEncoder enc;
+uint16_t count = 0;
+
+void setup()
+{
+  Serial2.begin(115200);
+
+  dec.begin(buf, sizeof(buf), FRAMING_COBS, true);
+  enc.begin(Serial2, FRAMING_COBS, true, block);
+
+  Serial2.setRxHook(FrameDecoder::rxHook, &dec);
+}
+
+void loop()
+{
+  if(dec.available())
+  {
+    count++;
+
+    enc.write((uint8_t)(count >> 8));
+    enc.write((uint8_t)count);
+    enc.write(dec.data(), dec.length());
+    enc.end();
+
+    dec.release();
+  }
+}
@@ -0,0 +1,406 @@
+/*
+  RCSerial.cpp - RC receiver serial protocol decoder for XMEGA
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "RCSerial.h"
+#include <util/crc16.h>
+
+#define RC_DISCARD 0xff /* '_len' - ignore everything until the next gap */
+
+#define SBUS_HEADER 0x0f
+#define SBUS_LENGTH 25
+#define SRXL_HEADER_12 0xa1
+#define SRXL_HEADER_16 0xa2
+#define IBUS_HEADER 0x20 /* this is also the frame length */
+#define IBUS_LENGTH 32
+#define SUMD_HEADER 0xa8
+#define SUMD_VALID 0x01
+#define SUMD_FAILSAFE 0x81
+
+RCSerialClass RCSerial;
+
+
+static bool rc_serial_hook(void *pCtx, uint8_t c, uint8_t stat)
+{
+  return ((RCSerialClass *)pCtx)->rxByte(c, stat);
+}
+
+RCSerialClass::RCSerialClass()
+{
+  _port = NULL;
+  _protocol = RC_SBUS;
+  _pub = 0;
+  _seq = 0;
+  _readSeq = 0;
+  _len = RC_DISCARD;
+  _expect = 0;
+  _frames = 0;
+  _errors = 0;
+
+  memset(_frame, 0, sizeof(_frame));
+}
+
+bool RCSerialClass::begin(HardwareSerial &port, uint8_t protocol, bool inverted)
+{
+  end();
+
+  if(protocol > RC_SUMD)
+  {
+    return false;
+  }
+
+  _port = &port;
+  _protocol = protocol;
+  _len = RC_DISCARD; // wait for a gap first
+  _last = micros();
+  _frames = 0;
+  _errors = 0;
+
+  if(protocol == RC_SBUS)
+  {
+    port.begin(100000, SERIAL_8E2);
+    port.setInverted(inverted, false);
+  }
+  else
+  {
+    port.begin(115200, SERIAL_8N1);
+  }
+
+  port.setRxHook(rc_serial_hook, this);
+
+  return true;
+}
+
+void RCSerialClass::end(void)
+{
+  if(_port)
+  {
+    _port->setRxHook(NULL, NULL);
+    _port->setInverted(false, false);
+    _port->end();
+
+    _port = NULL;
+  }
+}
+
+uint8_t RCSerialClass::read(uint16_t *pChannels, uint8_t maxChannels, unsigned long *pTime, uint8_t *pFlags)
+{
+RC_FRAME *pF;
+uint8_t bSeq, bCount;
+
+  do
+  {
+    bSeq = _seq;
+    pF = &(_frame[_pub]);
+
+    bCount = pF->count;
+
+    if(bCount > maxChannels)
+    {
+      bCount = maxChannels;
+    }
+
+    memcpy(pChannels, pF->channel, bCount * sizeof(uint16_t));
+
+    if(pTime)
+    {
+      *pTime = pF->time;
+    }
+
+    if(pFlags)
+    {
+      *pFlags = pF->flags;
+    }
+
+  } while(bSeq != _seq); // the ISR published a new frame while I was copying
+
+  _readSeq = bSeq;
+
+  return bCount; // 0 until the first frame is published
+}
+
+unsigned long RCSerialClass::frames(void)
+{
+unsigned long ulRval;
+uint8_t oldSREG = SREG;
+
+  cli();
+  ulRval = _frames;
+  SREG = oldSREG;
+
+  return ulRval;
+}
+
+unsigned long RCSerialClass::errors(void)
+{
+unsigned long ulRval;
+uint8_t oldSREG = SREG;
+
+  cli();
+  ulRval = _errors;
+  SREG = oldSREG;
+
+  return ulRval;
+}
+
+// first byte of a frame - sets the expected length.  returns 'false' if it's not a header
+bool RCSerialClass::header(uint8_t c)
+{
+  switch(_protocol)
+  {
+    case RC_SBUS:
+      _expect = SBUS_LENGTH;
+      return c == SBUS_HEADER;
+
+    case RC_SRXL:
+      _expect = c == SRXL_HEADER_16 ? 1 + 16 * 2 + 2 : 1 + 12 * 2 + 2;
+      return c == SRXL_HEADER_12 || c == SRXL_HEADER_16;
+
+    case RC_IBUS:
+      _expect = IBUS_LENGTH;
+      return c == IBUS_HEADER;
+
+    case RC_SUMD:
+      _expect = 0; // the 3rd byte has the number of channels
+      return c == SUMD_HEADER;
+  }
+
+  return false;
+}
+
+// update the checksum with a byte that is part of it
+void RCSerialClass::check(uint8_t c)
+{
+  if(_protocol == RC_IBUS)
+  {
+    _crc += c;
+  }
+  else
+  {
+    _crc = _crc_xmodem_update(_crc, c); // CRC16-CCITT, polynomial 1021H, start 0 (SRXL and SUMD)
+  }
+}
+
+bool RCSerialClass::rxByte(uint8_t c, uint8_t stat)
+{
+unsigned long ulNow = micros();
+RC_FRAME *pF;
+
+  if(ulNow - _last >= RC_FRAME_GAP_US) // a gap, so this is the first byte of a frame
+  {
+    if(_len != RC_DISCARD && _len) // the last frame was cut short
+    {
+      _errors++;
+    }
+
+    _len = 0;
+  }
+
+  _last = ulNow;
+
+  if(_len == RC_DISCARD)
+  {
+    return true; // the rest of a bad (or finished) frame
+  }
+
+  if((stat & (_BV(USART_FERR_bp) | _BV(USART_PERR_bp))) // a broken byte breaks the frame
+     || (!_len && !header(c)))
+  {
+    _errors++;
+    _len = RC_DISCARD;
+
+    return true;
+  }
+
+  if(!_len)
+  {
+    _start = ulNow;
+    _crc = 0;
+  }
+
+  // everything except the checksum at the end is checked (SBUS has none)
+  if(_protocol != RC_SBUS && (!_expect || _len < _expect - 2))
+  {
+    check(c);
+  }
+
+  _raw[_len++] = c;
+
+  if(_protocol == RC_SUMD && _len == 3) // number of channels
+  {
+    if(!c || c > RC_MAX_CHANNELS)
+    {
+      _errors++;
+      _len = RC_DISCARD;
+
+      return true;
+    }
+
+    _expect = 3 + 2 * c + 2;
+  }
+
+  if(_expect && _len >= _expect) // complete
+  {
+    _len = RC_DISCARD; // anything after it is junk until the next gap
+
+    pF = &(_frame[_pub ^ 1]); // the one 'read()' is not using
+
+    if(decode(pF))
+    {
+      pF->time = _start;
+
+      _pub ^= 1;
+      _seq++;
+      _frames++;
+    }
+    else
+    {
+      _errors++;
+    }
+  }
+
+  return true; // never goes into the RX buffer
+}
+
+// called from 'rxByte()' with a complete frame in '_raw'
+bool RCSerialClass::decode(RC_FRAME *pF)
+{
+uint8_t i1, i2, bBits;
+uint16_t w1;
+uint32_t dwBits;
+
+  pF->flags = 0;
+
+  switch(_protocol)
+  {
+    case RC_SBUS:
+      // end byte is 00H, or x4H for SBUS2
+      if(_raw[24] && (_raw[24] & 0x0f) != 0x04)
+      {
+        return false;
+      }
+
+      // 16 channels of 11 bits, LSB first, starting in byte 1
+      dwBits = 0;
+      bBits = 0;
+      i2 = 1;
+
+      for(i1=0; i1 < 16; i1++)
+      {
+        while(bBits < 11)
+        {
+          dwBits |= (uint32_t)_raw[i2++] << bBits;
+          bBits += 8;
+        }
+
+        w1 = (uint16_t)dwBits & 0x7ff;
+
+        dwBits >>= 11;
+        bBits -= 11;
+
+        pF->channel[i1] = (uint16_t)(((uint32_t)w1 * 5) >> 3) + 880; // 172 -> 988us, 1811 -> 2012us
+      }
+
+      pF->count = 16;
+
+      if(_raw[23] & 0x01)
+      {
+        pF->flags |= RC_FLAG_CH17;
+      }
+
+      if(_raw[23] & 0x02)
+      {
+        pF->flags |= RC_FLAG_CH18;
+      }
+
+      if(_raw[23] & 0x04)
+      {
+        pF->flags |= RC_FLAG_FRAME_LOST;
+      }
+
+      if(_raw[23] & 0x08)
+      {
+        pF->flags |= RC_FLAG_FAILSAFE;
+      }
+
+      return true;
+
+    case RC_SRXL:
+      if(_crc != (((uint16_t)_raw[_expect - 2] << 8) | _raw[_expect - 1]))
+      {
+        return false;
+      }
+
+      // 12-bit values, MSB first.  0 is 800us, 800H is 1500us, FFFH is 2200us
+      pF->count = (_expect - 3) / 2;
+
+      for(i1=0, i2=1; i1 < pF->count; i1++, i2 += 2)
+      {
+        w1 = (((uint16_t)_raw[i2] << 8) | _raw[i2 + 1]) & 0xfff;
+
+        pF->channel[i1] = 800 + (uint16_t)(((uint32_t)w1 * 175) >> 9); // * 1400 / 4096
+      }
+
+      return true;
+
+    case RC_IBUS:
+      // checksum is FFFFH minus the sum of all other bytes, LSB first
+      if((uint16_t)(0xffff - _crc) != (((uint16_t)_raw[31] << 8) | _raw[30]))
+      {
+        return false;
+      }
+
+      // 14 channels, LSB first, already in us.  The upper 4 bits are used by
+      // some receivers for more channels, so they're masked off
+      pF->count = 14;
+
+      for(i1=0, i2=2; i1 < 14; i1++, i2 += 2)
+      {
+        pF->channel[i1] = (((uint16_t)_raw[i2 + 1] << 8) | _raw[i2]) & 0xfff;
+      }
+
+      return true;
+
+    case RC_SUMD:
+      if(_crc != (((uint16_t)_raw[_expect - 2] << 8) | _raw[_expect - 1]))
+      {
+        return false;
+      }
+
+      if(_raw[1] == SUMD_FAILSAFE)
+      {
+        pF->flags |= RC_FLAG_FAILSAFE;
+      }
+      else if(_raw[1] != SUMD_VALID)
+      {
+        return false;
+      }
+
+      // values in 1/8 us, MSB first
+      pF->count = _raw[2];
+
+      for(i1=0, i2=3; i1 < pF->count; i1++, i2 += 2)
+      {
+        pF->channel[i1] = (((uint16_t)_raw[i2] << 8) | _raw[i2 + 1]) >> 3;
+      }
+
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,129 @@
+/*
+  RCSerial.h - RC receiver serial protocol decoder for XMEGA
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+  Decodes the serial output of an RC receiver while the bytes arrive, inside the
+  RXC interrupt of a HardwareSerial port (see 'HardwareSerial::setRxHook()').  The
+  bytes never go through the RX buffer, and 'loop()' does no parsing at all.
+
+  Protocols:
+    RC_SBUS   Futaba SBUS, 100000 baud 8E2, inverted (INVEN on the RX pin), 16 channels
+    RC_SRXL   Multiplex SRXL, 115200 baud 8N1, 12 or 16 channels, CRC16
+    RC_IBUS   FlySky IBUS, 115200 baud 8N1, 14 channels, checksum
+    RC_SUMD   Graupner SUMD, 115200 baud 8N1, up to RC_MAX_CHANNELS channels, CRC16
+
+  A frame starts after a gap of at least RC_FRAME_GAP_US between 2 bytes.  A bad
+  header, a UART error, or a bad checksum throws the frame away, and the decoder
+  waits for the next gap.
+
+  Decoded frames go into a double buffer.  The ISR fills the one that is not
+  published, then switches.  'read()' copies the published one, and checks a
+  sequence number to find out if the ISR published another frame meanwhile
+  (in which case it copies again).  No interrupts are disabled for reading.
+
+  All channel values are in microseconds (appx 1000-2000, center 1500), whatever
+  the protocol uses on the wire.  The time is 'micros()' at the first byte.
+
+  Usage:
+    RCSerial.begin(Serial2, RC_SBUS);
+    ...
+    if(RCSerial.available())
+    {
+      uint16_t ch[RC_MAX_CHANNELS];
+      unsigned long t;
+      uint8_t n = RCSerial.read(ch, RC_MAX_CHANNELS, &t);
+      ...
+    }
+*/
+
+#ifndef _RCSERIAL_H_INCLUDED
+#define _RCSERIAL_H_INCLUDED
+
+#include <Arduino.h>
+
+#define RC_SBUS 0
+#define RC_SRXL 1
+#define RC_IBUS 2
+#define RC_SUMD 3
+
+#define RC_MAX_CHANNELS 16
+#define RC_FRAME_GAP_US 500 /* longer than any gap between bytes IN a frame, shorter than between frames */
+
+// 'flags' from 'read()'
+#define RC_FLAG_FAILSAFE   1 /* the receiver lost the transmitter, values are the failsafe values */
+#define RC_FLAG_FRAME_LOST 2 /* SBUS only - the receiver lost a frame */
+#define RC_FLAG_CH17       4 /* SBUS only - digital channel 17 */
+#define RC_FLAG_CH18       8 /* SBUS only - digital channel 18 */
+
+#define RC_RAW_MAX (3 + 2 * RC_MAX_CHANNELS + 2) /* longest frame that is kept (SUMD) */
+
+class RCSerialClass
+{
+public:
+  RCSerialClass();
+
+  // starts 'port' with the protocol's baud rate and format, and hooks into its RXC ISR.
+  // 'inverted' is for SBUS only - use 'false' if the board already has an inverter.
+  bool begin(HardwareSerial &port, uint8_t protocol, bool inverted = true);
+  void end(void);
+
+  // 'true' when a frame came in since the last 'read()'
+  inline bool available(void) { return _seq != _readSeq; }
+
+  // copies the latest frame, returns the number of channels in it (0 if there was none yet).
+  // 'pTime' and 'pFlags' can be NULL
+  uint8_t read(uint16_t *pChannels, uint8_t maxChannels, unsigned long *pTime = NULL, uint8_t *pFlags = NULL);
+
+  unsigned long frames(void); // good frames
+  unsigned long errors(void); // frames thrown away
+
+  // called from the RXC ISR - not for use by sketches
+  bool rxByte(uint8_t c, uint8_t stat);
+
+protected:
+  typedef struct _RC_FRAME_
+  {
+    uint16_t channel[RC_MAX_CHANNELS];
+    unsigned long time;          // 'micros()' at the first byte
+    uint8_t count;               // number of channels
+    uint8_t flags;               // RC_FLAG_xx
+  } RC_FRAME;
+
+  RC_FRAME _frame[2];
+  volatile uint8_t _pub;         // the frame that 'read()' uses
+  volatile uint8_t _seq;         // +1 for every published frame
+  uint8_t _readSeq;              // '_seq' at the last 'read()'
+
+  HardwareSerial *_port;
+  uint8_t _protocol;
+  uint8_t _raw[RC_RAW_MAX];      // the frame so far
+  uint8_t _len;                  // bytes in '_raw', RC_DISCARD to wait for the next gap
+  uint8_t _expect;               // length of the whole frame, 0 while not known (SUMD)
+  uint16_t _crc;                 // CRC16 (SRXL, SUMD) or sum (IBUS) so far
+  unsigned long _last;           // 'micros()' at the last byte
+  unsigned long _start;          // 'micros()' at the first byte of this frame
+  volatile unsigned long _frames;
+  volatile unsigned long _errors;
+
+  bool header(uint8_t c);
+  void check(uint8_t c);
+  bool decode(RC_FRAME *pF);
+};
+
+extern RCSerialClass RCSerial;
+
+#endif // _RCSERIAL_H_INCLUDED
@@ -0,0 +1,36 @@
+/*
+  RC Serial Read
+
+  Decodes SBUS from a receiver on 'Serial2' and prints the first 4 channels
+  (in microseconds) and the age of the frame on 'Serial'.
+*/
+
+#include <RCSerial.h>
+
+void setup()
+{
+  Serial.begin(115200);
+
+  RCSerial.begin(Serial2, RC_SBUS);
+}
+
+void loop()
+{
+  uint16_t ch[RC_MAX_CHANNELS];
+  unsigned long t;
+  uint8_t flags, n;
+
+  if(RCSerial.available())
+  {
+    n = RCSerial.read(ch, RC_MAX_CHANNELS, &t, &flags);
+
+    for(uint8_t i = 0; i < n && i < 4; i++)
+    {
+      Serial.print(ch[i]);
+      Serial.print(' ');
+    }
+
+    Serial.print(micros() - t);
+    Serial.println(flags & RC_FLAG_FAILSAFE ? "us FAILSAFE" : "us");
+  }
+}
@@ -93,7 +93,7 @@
   #define SPI_MODE0 0x00
   #define SPI_MODE1 SPI_MODE0_bm
   #define SPI_MODE2 SPI_MODE1_bm
-  #define SPI_MODE3 (SPI_MODE0_bm | SPI_MODE0_bm)
+  #define SPI_MODE3 (SPI_MODE0_bm | SPI_MODE1_bm)
 
   #define SPI_MODE_MASK    SPI_MODE_gm
   #define SPI_CLOCK_MASK   SPI_PRESCALER_gm
@@ -0,0 +1,250 @@
+/*
+  USARTSPI.cpp - SPI master on an XMEGA USART (MSPI mode)
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "pins_arduino.h"
+#include "USARTSPI.h"
+
+// CTRLC in MSPI mode (A manual sect 20.9.3) - these bits are CHSIZE in UART mode
+#define USARTSPI_UDORD_bm 0x04 /* LSB first */
+#define USARTSPI_UCPHA_bm 0x02 /* sample on the trailing edge */
+
+#define XCK_PIN  1 /* pin numbers on the port for USARTx0 */
+#define RXD_PIN  2
+#define TXD_PIN  3
+
+
+USARTSPIClass::USARTSPIClass(USART_t *usart, PORT_t *port, uint8_t ss)
+{
+  _usart = usart;
+  _port = port;
+  _ss = ss;
+  _pin = ((uint16_t)usart & 0x10) ? 4 : 0; // USARTx1 is 10H above USARTx0
+}
+
+void USARTSPIClass::begin()
+{
+uint8_t oldSREG;
+
+  // Set SS to high so a connected chip will be "deselected" by default
+  digitalWrite(_ss, HIGH);
+  pinMode(_ss, OUTPUT);
+
+  oldSREG = SREG;
+  cli();
+
+  _usart->CTRLA = 0; // no interrupts, everything is polled
+  _usart->CTRLB = 0;
+
+  // SCK and MOSI are outputs, MISO is an input (sect 20.6).  SCK idles LOW for modes 0 and 1
+  *(&(_port->PIN0CTRL) + XCK_PIN + _pin) &= ~PORT_INVEN_bm;
+  _port->OUTCLR = _BV(XCK_PIN + _pin);
+  _port->OUTSET = _BV(TXD_PIN + _pin);
+  _port->DIRSET = _BV(XCK_PIN + _pin) | _BV(TXD_PIN + _pin);
+  _port->DIRCLR = _BV(RXD_PIN + _pin);
+
+  _usart->CTRLC = USART_CMODE_MSPI_gc; // mode 0, MSB first
+  _usart->BAUDCTRLA = 1;               // F_CPU / 4, like SPI_CLOCK_DIV4
+  _usart->BAUDCTRLB = 0;               // BSCALE must be 0 in MSPI mode
+  _usart->CTRLB = USART_RXEN_bm | USART_TXEN_bm; // no CLK2X in MSPI mode
+
+  SREG = oldSREG;
+}
+
+void USARTSPIClass::end()
+{
+  _usart->CTRLB = 0;
+  _usart->CTRLC = 0;
+
+  *(&(_port->PIN0CTRL) + XCK_PIN + _pin) &= ~PORT_INVEN_bm;
+  _port->DIRCLR = _BV(XCK_PIN + _pin) | _BV(TXD_PIN + _pin);
+}
+
+byte USARTSPIClass::transfer(byte _data)
+{
+  _usart->DATA = _data;
+
+  while(!(_usart->STATUS & USART_RXCIF_bm))
+    ;
+
+  return _usart->DATA;
+}
+
+uint16_t USARTSPIClass::transfer16(uint16_t data)
+{
+uint16_t wRval;
+
+  _usart->DATA = (uint8_t)(data >> 8);
+
+  while(!(_usart->STATUS & USART_DREIF_bm))
+    ;
+
+  _usart->DATA = (uint8_t)data; // the transmit buffer takes it while the first is sent
+
+  while(!(_usart->STATUS & USART_RXCIF_bm))
+    ;
+
+  wRval = (uint16_t)_usart->DATA << 8;
+
+  while(!(_usart->STATUS & USART_RXCIF_bm))
+    ;
+
+  return wRval | _usart->DATA;
+}
+
+// One byte is always waiting in the transmit buffer while the one before it is shifted, so
+// SCK never stops.  The receive buffer is 2 deep as well, so reading a byte late loses nothing.
+void USARTSPIClass::transfer(void *buf, size_t count)
+{
+uint8_t *pBuf = (uint8_t *)buf;
+size_t i1;
+
+  if(!count)
+  {
+    return;
+  }
+
+  _usart->DATA = pBuf[0];
+
+  for(i1=1; i1 < count; i1++)
+  {
+    while(!(_usart->STATUS & USART_DREIF_bm))
+      ;
+
+    _usart->DATA = pBuf[i1];
+
+    while(!(_usart->STATUS & USART_RXCIF_bm))
+      ;
+
+    pBuf[i1 - 1] = _usart->DATA;
+  }
+
+  while(!(_usart->STATUS & USART_RXCIF_bm))
+    ;
+
+  pBuf[count - 1] = _usart->DATA;
+}
+
+void USARTSPIClass::write(const void *buf, size_t count)
+{
+const uint8_t *pBuf = (const uint8_t *)buf;
+size_t i1;
+uint8_t bJunk;
+
+  if(!count)
+  {
+    return;
+  }
+
+  _usart->STATUS = USART_TXCIF_bm; // write 1 to clear
+
+  for(i1=0; i1 < count; i1++)
+  {
+    while(!(_usart->STATUS & USART_DREIF_bm))
+      ;
+
+    _usart->DATA = pBuf[i1];
+
+    if(_usart->STATUS & USART_RXCIF_bm) // keep the receiver from overflowing
+    {
+      bJunk = _usart->DATA;
+    }
+  }
+
+  while(!(_usart->STATUS & USART_TXCIF_bm)) // the last bit is out
+    ;
+
+  while(_usart->STATUS & USART_RXCIF_bm)
+  {
+    bJunk = _usart->DATA;
+  }
+
+  (void)bJunk;
+}
+
+void USARTSPIClass::setBitOrder(uint8_t bitOrder)
+{
+  if(bitOrder == LSBFIRST) {
+    _usart->CTRLC |= USARTSPI_UDORD_bm;
+  } else {
+    _usart->CTRLC &= ~USARTSPI_UDORD_bm;
+  }
+}
+
+// CPHA is UCPHA, CPOL is the INVEN bit of the XCK pin (sect 20.5)
+void USARTSPIClass::setDataMode(uint8_t mode)
+{
+volatile uint8_t *pCtrl = &(_port->PIN0CTRL) + XCK_PIN + _pin;
+
+  if(mode & SPI_MODE0_bm) // CPHA
+  {
+    _usart->CTRLC |= USARTSPI_UCPHA_bm;
+  }
+  else
+  {
+    _usart->CTRLC &= ~USARTSPI_UCPHA_bm;
+  }
+
+  if(mode & SPI_MODE1_bm) // CPOL
+  {
+    *pCtrl |= PORT_INVEN_bm;
+  }
+  else
+  {
+    *pCtrl &= ~PORT_INVEN_bm;
+  }
+}
+
+void USARTSPIClass::setClockDivider(uint8_t rate)
+{
+static const uint8_t aDiv[4] = { 4, 16, 64, 128 }; // SPI_PRESCALER_gm
+uint8_t bDiv = aDiv[rate & SPI_PRESCALER_gm];
+
+  if((rate & SPI_CLK2X_bm) && bDiv < 128) // DIV128 with CLK2X is also 64 on the SPI peripheral
+  {
+    bDiv >>= 1;
+  }
+
+  // fSCK = F_CPU / (2 * (BSEL + 1))  (sect 20.3.1)
+  _usart->BAUDCTRLA = (bDiv >> 1) - 1;
+  _usart->BAUDCTRLB = 0;
+}
+
+unsigned long USARTSPIClass::setClock(unsigned long hz)
+{
+unsigned long ulBSEL;
+
+  if(!hz)
+  {
+    hz = 1;
+  }
+
+  // round up, so the clock is never faster than asked for
+  ulBSEL = (F_CPU / 2 + hz - 1) / hz;
+  ulBSEL = ulBSEL ? ulBSEL - 1 : 0;
+
+  if(ulBSEL > 4095)
+  {
+    ulBSEL = 4095;
+  }
+
+  _usart->BAUDCTRLA = (uint8_t)ulBSEL;
+  _usart->BAUDCTRLB = (uint8_t)(ulBSEL >> 8); // BSCALE stays 0
+
+  return F_CPU / (2 * (ulBSEL + 1));
+}
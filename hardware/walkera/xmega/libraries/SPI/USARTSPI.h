@@ -0,0 +1,72 @@
+/*
+  USARTSPI.h - SPI master on an XMEGA USART (MSPI mode)
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+  Every XMEGA USART can be an SPI master (A manual sect 20).  XCK is SCK, TXD is
+  MOSI and RXD is MISO - pins 1, 3 and 2 for USARTx0, pins 5, 7 and 6 for USARTx1.
+  Unlike the SPI peripheral, the transmitter has a buffer, so the next byte can
+  be written while the current one is shifted out.  'transfer(buf, count)' uses
+  that, so back to back bytes have no gap between them.
+
+  It has the same methods and constants as 'SPIClass' (SPI_MODEn, SPI_CLOCK_DIVn,
+  MSBFIRST/LSBFIRST), so code written for 'SPI' works with it.  The clock can also
+  be set in Hz, from F_CPU/2 down to F_CPU/8192.
+
+  The USART can't be used by HardwareSerial at the same time.
+
+    USARTSPI_DEFINE(SPI2, USARTC0, PORTC, 4); // name, USART, its port, chip select pin
+
+    SPI2.begin();
+    SPI2.setClock(8000000);
+    digitalWrite(4, LOW);
+    SPI2.transfer(buf, sizeof(buf));
+    digitalWrite(4, HIGH);
+*/
+
+#ifndef _USARTSPI_H_INCLUDED
+#define _USARTSPI_H_INCLUDED
+
+#include <Arduino.h>
+#include "SPI.h"
+
+#define USARTSPI_DEFINE(name, usart, port, cs) USARTSPIClass name(&(usart), &(port), cs)
+
+class USARTSPIClass {
+public:
+  USARTSPIClass(USART_t *usart, PORT_t *port, uint8_t ss);
+
+  void begin();
+  void end();
+
+  byte transfer(byte _data);
+  uint16_t transfer16(uint16_t data);              // MSB first, whatever the bit order
+  void transfer(void *buf, size_t count);          // in place, pipelined
+  void write(const void *buf, size_t count);       // ignores what comes back, pipelined
+
+  void setBitOrder(uint8_t);
+  void setDataMode(uint8_t);                       // SPI_MODE0 - SPI_MODE3
+  void setClockDivider(uint8_t);                   // SPI_CLOCK_DIV2 - SPI_CLOCK_DIV128
+  unsigned long setClock(unsigned long hz);        // returns the clock you really get
+
+private:
+  USART_t *_usart;
+  PORT_t *_port;
+  uint8_t _ss;
+  uint8_t _pin;         // 0 for USARTx0, 4 for USARTx1 - added to the pin numbers on the port
+};
+
+#endif // _USARTSPI_H_INCLUDED
@@ -0,0 +1,55 @@
+/*
+  USART SPI Flash
+
+  Reads the JEDEC ID and the first 16 bytes of a SPI flash chip on a second
+  SPI bus, USARTC0 in master SPI mode (PC1 SCK, PC3 MOSI, PC2 MISO), and
+  prints them on 'Serial'.  'Serial2' uses USARTC0 as well, so don't start it.
+*/
+
+#include <SPI.h>
+#include <USARTSPI.h>
+
+#define FLASH_CS 4 // chip select - change this for your board
+
+USARTSPI_DEFINE(SPI2, USARTC0, PORTC, FLASH_CS);
+
+void setup()
+{
+  uint8_t buf[4 + 16];
+
+  Serial.begin(115200);
+
+  SPI2.begin();
+  SPI2.setDataMode(SPI_MODE0);
+  SPI2.setClock(8000000);
+
+  digitalWrite(FLASH_CS, LOW);
+  SPI2.transfer(0x9f); // JEDEC ID
+  Serial.print(SPI2.transfer(0), HEX);
+  Serial.print(' ');
+  Serial.print(SPI2.transfer16(0), HEX);
+  Serial.println();
+  digitalWrite(FLASH_CS, HIGH);
+
+  buf[0] = 0x03; // read, address 0
+  buf[1] = 0;
+  buf[2] = 0;
+  buf[3] = 0;
+  memset(buf + 4, 0, 16);
+
+  digitalWrite(FLASH_CS, LOW);
+  SPI2.transfer(buf, sizeof(buf)); // no gaps between the bytes
+  digitalWrite(FLASH_CS, HIGH);
+
+  for(uint8_t i = 4; i < sizeof(buf); i++)
+  {
+    Serial.print(buf[i], HEX);
+    Serial.print(' ');
+  }
+
+  Serial.println();
+}
+
+void loop()
+{
+}
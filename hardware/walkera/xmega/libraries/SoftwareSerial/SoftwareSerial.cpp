@@ -0,0 +1,526 @@
+/*
+  SoftwareSerial.cpp - interrupt driven software UART for XMEGA
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "SoftwareSerial.h"
+
+// The timer needs 4 CC channels (a TC0_t).  Channel A captures the event channel EVSEL, since
+// its CCAEN is the only one set (A manual sect 14.6.1), B and C are plain compare channels.
+// There is no free timer on the RX boards, so TCE0 is shared - every user of it ('tone()',
+// softPWM, 'Serial.beginAuto()' and this) claims it with 'timerClaim()' first.  All ports of
+// this library share one claim, the last 'end()' releases it.  The event channel is one of its
+// own (CH6), 'Serial.beginAuto()' has CH7
+#ifndef SOFTSERIAL_TIMER
+#define SOFTSERIAL_TIMER TCE0
+#define SOFTSERIAL_CAPT_vect TCE0_CCA_vect
+#define SOFTSERIAL_RX_vect TCE0_CCB_vect
+#define SOFTSERIAL_TX_vect TCE0_CCC_vect
+#define SOFTSERIAL_EVSYS_MUX EVSYS_CH6MUX
+#define SOFTSERIAL_EVSEL TC_EVSEL_CH6_gc
+#endif // SOFTSERIAL_TIMER
+
+#define SOFTSERIAL_CAPT_INTLVL TC_CCAINTLVL_HI_gc
+#define SOFTSERIAL_RX_INTLVL TC_CCBINTLVL_HI_gc
+#define SOFTSERIAL_TX_INTLVL TC_CCCINTLVL_HI_gc
+
+// appx timer counts from the compare match to reading the pin in 'rx_bit()' (interrupt
+// response, plus the ISR prologue).  The first sample is moved up by this much
+#define SOFTSERIAL_RX_LATENCY 24
+
+#define SOFTSERIAL_RX_MASK (SOFTSERIAL_RX_BUFFER_SIZE - 1)
+#define SOFTSERIAL_TX_MASK (SOFTSERIAL_TX_BUFFER_SIZE - 1)
+
+
+static SoftwareSerial *softserial_active = NULL; // the one that owns the timer
+
+
+// number of a PORT from PORTA (0) to PORTF (5), higher for anything else (PORTR)
+static uint8_t softserial_port_index(PORT_t *pPort)
+{
+  return (uint8_t)(((uint16_t)pPort - (uint16_t)&PORTA) / sizeof(PORT_t));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// interrupt level - everything here runs with interrupts disabled.  'inline', so that the
+// ISRs don't have to save all of the registers for a call
+
+// start the next byte with its start bit, or stop when the TX buffer is empty.  The
+// timing for the first byte starts now, after that it continues from the last bit
+inline void SoftwareSerial::tx_next(void)
+{
+  if(_tx_head == _tx_tail)
+  {
+    SOFTSERIAL_TIMER.INTCTRLB &= ~TC0_CCCINTLVL_gm;
+    _tx_busy = 0;
+
+    return;
+  }
+
+  _tx_data = _tx_buf[_tx_tail];
+  _tx_tail = (_tx_tail + 1) & SOFTSERIAL_TX_MASK;
+  _tx_state = 0;
+
+  _tx_port->OUTCLR = _tx_mask; // start bit
+
+  if(!_tx_busy)
+  {
+    SOFTSERIAL_TIMER.CCC = SOFTSERIAL_TIMER.CNT + _bit_time;
+    SOFTSERIAL_TIMER.INTFLAGS = TC0_CCCIF_bm;
+    SOFTSERIAL_TIMER.INTCTRLB |= SOFTSERIAL_TX_INTLVL;
+
+    _tx_busy = 1;
+  }
+}
+
+// end of a TX bit - the pin changes first, so that the ISR latency is the same for every bit
+inline void SoftwareSerial::tx_bit(void)
+{
+  if(_tx_state < 8)
+  {
+    if(_tx_data & 1)
+    {
+      _tx_port->OUTSET = _tx_mask;
+    }
+    else
+    {
+      _tx_port->OUTCLR = _tx_mask;
+    }
+
+    _tx_data >>= 1;
+    _tx_state++;
+  }
+  else if(_tx_state == 8)
+  {
+    _tx_port->OUTSET = _tx_mask; // stop bit
+    _tx_state++;
+  }
+  else
+  {
+    SOFTSERIAL_TIMER.CCC += _bit_time;
+
+    tx_next(); // the stop bit is done
+
+    return;
+  }
+
+  SOFTSERIAL_TIMER.CCC += _bit_time; // from the last match, so late interrupts don't add up
+}
+
+// falling edge at 'wEdge' - sample the middle of the start bit, then every bit after that.
+// No more captures until the byte is done
+inline void SoftwareSerial::rx_start(uint16_t wEdge)
+{
+uint16_t wNext = wEdge + (_bit_time >> 1) - SOFTSERIAL_RX_LATENCY;
+
+  _rx_state = 0;
+
+  if((int16_t)(wNext - SOFTSERIAL_TIMER.CNT) < 8) // served too late for the start bit, so skip its check
+  {
+    wNext += _bit_time;
+    _rx_state = 1;
+  }
+
+  SOFTSERIAL_TIMER.CCB = wNext;
+  SOFTSERIAL_TIMER.INTFLAGS = TC0_CCBIF_bm;
+  SOFTSERIAL_TIMER.INTCTRLB = (SOFTSERIAL_TIMER.INTCTRLB & ~(TC0_CCAINTLVL_gm | TC0_CCBINTLVL_gm))
+                            | SOFTSERIAL_RX_INTLVL;
+}
+
+// wait for the next start bit.  The edges of the data bits were captured as well, drop them
+// (the capture buffer is 2 deep, reading CCA moves the next one up)
+inline void SoftwareSerial::rx_idle(void)
+{
+  while(SOFTSERIAL_TIMER.INTFLAGS & TC0_CCAIF_bm)
+  {
+    (void)SOFTSERIAL_TIMER.CCA;
+  }
+
+  SOFTSERIAL_TIMER.INTCTRLB = (SOFTSERIAL_TIMER.INTCTRLB & ~TC0_CCBINTLVL_gm) | SOFTSERIAL_CAPT_INTLVL;
+}
+
+inline void SoftwareSerial::rx_bit(void)
+{
+uint8_t bIn = _rx_port->IN & _rx_mask; // first, so the sample is on time
+uint8_t bNext;
+
+  SOFTSERIAL_TIMER.CCB += _bit_time;
+
+  if(!_rx_state)
+  {
+    if(bIn) // not LOW in the middle - a glitch, not a start bit
+    {
+      rx_idle();
+
+      return;
+    }
+  }
+  else if(_rx_state <= 8)
+  {
+    _rx_data >>= 1; // LSB first
+
+    if(bIn)
+    {
+      _rx_data |= 0x80;
+    }
+  }
+  else
+  {
+    if(bIn) // stop bit
+    {
+      bNext = (_rx_head + 1) & SOFTSERIAL_RX_MASK;
+
+      if(bNext != _rx_tail)
+      {
+        _rx_buf[_rx_head] = _rx_data;
+        _rx_head = bNext;
+      }
+      else
+      {
+        _overflow = 1;
+      }
+    }
+    else
+    {
+      _framing++;
+    }
+
+    rx_idle();
+
+    return;
+  }
+
+  _rx_state++;
+}
+
+
+SoftwareSerial::SoftwareSerial(uint8_t rxPin, uint8_t txPin, bool inverse)
+{
+  _rx_pin = rxPin;
+  _tx_pin = txPin;
+  _inverse = inverse;
+  _rx_port = NULL;
+  _tx_port = NULL;
+  _rx_mask = 0;
+  _tx_mask = 0;
+  _bit_time = 0;
+  _rx_state = 0;
+  _rx_data = 0;
+  _tx_state = 0;
+  _tx_data = 0;
+  _tx_busy = 0;
+  _rx_head = _rx_tail = 0;
+  _tx_head = _tx_tail = 0;
+  _overflow = 0;
+  _framing = 0;
+}
+
+SoftwareSerial::~SoftwareSerial()
+{
+  end();
+}
+
+bool SoftwareSerial::begin(unsigned long baud)
+{
+uint8_t port;
+
+  end();
+
+  if(!baud || baud > SOFTSERIAL_MAX_BAUD || F_CPU / baud > 0xffffUL) // one bit must fit the 16-bit count
+  {
+    return false;
+  }
+
+  port = digitalPinToPort(_rx_pin);
+
+  if(port == NOT_A_PIN)
+  {
+    return false;
+  }
+
+  _rx_port = (PORT_t *)portModeRegister(port);
+  _rx_mask = digitalPinToBitMask(_rx_pin);
+
+  if(softserial_port_index(_rx_port) > 5) // the event system has no PORTR pins
+  {
+    return false;
+  }
+
+  port = digitalPinToPort(_tx_pin);
+
+  if(port == NOT_A_PIN)
+  {
+    return false;
+  }
+
+  _tx_port = (PORT_t *)portModeRegister(port);
+  _tx_mask = digitalPinToBitMask(_tx_pin);
+
+  _bit_time = (uint16_t)((F_CPU + baud / 2) / baud);
+
+  // TX - output, idle HIGH.  With 'inverse', INVEN flips both pins in the port logic
+  // (A manual sect 13.13.15), so everything else stays the same
+  *(&(_tx_port->PIN0CTRL) + pinBitValueToIndex(_tx_mask)) = _inverse ? PORT_INVEN_bm : 0;
+  _tx_port->OUTSET = _tx_mask;
+  _tx_port->DIRSET = _tx_mask;
+
+  // RX - input with pull-up (pull-down when inverted, the line idles LOW).  The falling edge
+  // (after inversion) is what goes to the event system
+  _rx_port->DIRCLR = _rx_mask;
+  *(&(_rx_port->PIN0CTRL) + pinBitValueToIndex(_rx_mask))
+    = (_inverse ? (PORT_OPC_PULLDOWN_gc | PORT_INVEN_bm) : PORT_OPC_PULLUP_gc) | PORT_ISC_FALLING_gc;
+
+  _rx_head = _rx_tail = 0;
+  _tx_head = _tx_tail = 0;
+  _overflow = 0;
+  _framing = 0;
+
+  if(!start())
+  {
+    _bit_time = 0;
+
+    return false;
+  }
+
+  return true;
+}
+
+void SoftwareSerial::end(void)
+{
+  stop();
+
+  _bit_time = 0;
+
+  if(!softserial_active) // no other port is listening
+  {
+    timerRelease(&SOFTSERIAL_TIMER, TIMER_OWNER_SOFTSERIAL);
+  }
+}
+
+bool SoftwareSerial::listen(void)
+{
+  if(!_bit_time || softserial_active == this)
+  {
+    return false;
+  }
+
+  return start();
+}
+
+bool SoftwareSerial::isListening(void)
+{
+  return softserial_active == this;
+}
+
+// take over the timer from the port that was listening, if any
+bool SoftwareSerial::start(void)
+{
+uint8_t oldSREG;
+
+  // the timer is only mine to take over if it is free, or one of my ports has it
+  if(!timerClaim(&SOFTSERIAL_TIMER, TIMER_OWNER_SOFTSERIAL)) // 'tone()', softPWM, etc.
+  {
+    return false;
+  }
+
+  if(softserial_active)
+  {
+    softserial_active->stop(); // lets it send what it has first
+  }
+
+  oldSREG = SREG;
+  cli();
+
+  softserial_active = this;
+  _rx_state = 0;
+  _tx_busy = 0;
+
+  // RX pin -> event channel -> capture into CCA (A manual sect 6.8.3)
+  SOFTSERIAL_EVSYS_MUX = EVSYS_CHMUX_PORTA_PIN0_gc
+                       + softserial_port_index(_rx_port) * 8 + pinBitValueToIndex(_rx_mask);
+
+  SOFTSERIAL_TIMER.CTRLA = 0;
+  SOFTSERIAL_TIMER.CTRLFSET = TC_CMD_RESET_gc;
+  SOFTSERIAL_TIMER.PER = 0xffff;                // free running, all the math wraps at 16 bits
+  SOFTSERIAL_TIMER.CTRLB = TC0_CCAEN_bm;        // normal mode, capture A, B and C compare only
+  SOFTSERIAL_TIMER.CTRLD = TC_EVACT_CAPT_gc | SOFTSERIAL_EVSEL;
+  SOFTSERIAL_TIMER.INTCTRLA = 0;
+  SOFTSERIAL_TIMER.INTCTRLB = SOFTSERIAL_CAPT_INTLVL;
+  SOFTSERIAL_TIMER.CTRLA = TC_CLKSEL_DIV1_gc;
+
+  tx_next(); // anything written while not listening
+
+  SREG = oldSREG;
+
+  return true;
+}
+
+void SoftwareSerial::stop(void)
+{
+uint8_t oldSREG;
+
+  if(softserial_active != this)
+  {
+    return;
+  }
+
+  flush();
+
+  oldSREG = SREG;
+  cli();
+
+  SOFTSERIAL_TIMER.INTCTRLB = 0;               // no CC interrupts BEFORE the pointer goes away
+  SOFTSERIAL_TIMER.CTRLA = 0;
+  SOFTSERIAL_TIMER.CTRLFSET = TC_CMD_RESET_gc;  // also clears any pending flags
+  SOFTSERIAL_EVSYS_MUX = 0;
+
+  _tx_port->OUTSET = _tx_mask; // in case it stopped in the middle of a byte
+  _tx_busy = 0;
+
+  softserial_active = NULL;
+
+  SREG = oldSREG;
+}
+
+bool SoftwareSerial::overflow(void)
+{
+bool bRval = _overflow;
+
+  _overflow = 0;
+
+  return bRval;
+}
+
+unsigned int SoftwareSerial::framingErrors(bool bClear)
+{
+unsigned int iRval;
+uint8_t oldSREG = SREG;
+
+  cli();
+
+  iRval = _framing;
+
+  if(bClear)
+  {
+    _framing = 0;
+  }
+
+  SREG = oldSREG;
+
+  return iRval;
+}
+
+int SoftwareSerial::available(void)
+{
+  return (uint8_t)(_rx_head - _rx_tail) & SOFTSERIAL_RX_MASK;
+}
+
+int SoftwareSerial::peek(void)
+{
+  if(_rx_head == _rx_tail)
+  {
+    return -1;
+  }
+
+  return _rx_buf[_rx_tail];
+}
+
+int SoftwareSerial::read(void)
+{
+uint8_t c;
+
+  if(_rx_head == _rx_tail)
+  {
+    return -1;
+  }
+
+  c = _rx_buf[_rx_tail];
+  _rx_tail = (_rx_tail + 1) & SOFTSERIAL_RX_MASK; // only 'read()' writes the tail
+
+  return c;
+}
+
+void SoftwareSerial::flush(void)
+{
+  while(_tx_busy && softserial_active == this && (SREG & CPU_I_bm))
+    ;
+}
+
+size_t SoftwareSerial::write(uint8_t c)
+{
+uint8_t bNext, oldSREG;
+
+  if(!_bit_time)
+  {
+    return 0;
+  }
+
+  bNext = (_tx_head + 1) & SOFTSERIAL_TX_MASK;
+
+  while(bNext == _tx_tail) // full
+  {
+    if(softserial_active != this || !(SREG & CPU_I_bm))
+    {
+      return 0; // nothing is going to empty it
+    }
+  }
+
+  _tx_buf[_tx_head] = c;
+
+  oldSREG = SREG;
+  cli();
+
+  _tx_head = bNext;
+
+  if(!_tx_busy && softserial_active == this)
+  {
+    tx_next(); // the start bit goes out right now
+  }
+
+  SREG = oldSREG;
+
+  return 1;
+}
+
+
+// 'stop()' turns the interrupts off before it clears 'softserial_active', so it is never NULL
+// here.  The checks are for the timer being re-configured by something else
+ISR(SOFTSERIAL_CAPT_vect)
+{
+uint16_t wEdge = SOFTSERIAL_TIMER.CCA; // reading CCA clears CCAIF
+
+  if(softserial_active)
+  {
+    softserial_active->rx_start(wEdge);
+  }
+}
+
+ISR(SOFTSERIAL_RX_vect)
+{
+  if(softserial_active)
+  {
+    softserial_active->rx_bit();
+  }
+}
+
+ISR(SOFTSERIAL_TX_vect)
+{
+  if(softserial_active)
+  {
+    softserial_active->tx_bit();
+  }
+}
@@ -0,0 +1,125 @@
+/*
+  SoftwareSerial.h - interrupt driven software UART for XMEGA
+  Part of the Walkino project
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+  An extra serial port on any 2 pins of PORTA-PORTF, for when the USARTs are taken (the RX
+  boards only bring out SERIAL_0 and SERIAL_1).  Unlike a bit-banging UART, it never disables
+  interrupts for a whole byte.  Every bit is one short interrupt instead:
+
+    - a 16-bit timer runs freely at F_CPU.  Compare channel C times the TX bits and compare
+      channel B the RX bits, so sending and receiving happen at the same time (full duplex).
+    - the RX pin is an event source, and the event system captures the timer count of the
+      falling edge of the start bit in channel A (A manual sect 6 and 14.6).  The bit timing
+      starts at the real edge, no matter how late the capture interrupt is served.
+    - every bit is sampled in the middle, a start bit that is not LOW in its middle is noise,
+      and a byte without a stop bit is counted as a framing error.
+
+  Up to 57600 baud at 16Mhz, full duplex.  At 57600 there is an interrupt every 278 cycles in
+  each direction, so that takes a good part of the CPU.  Other interrupts at HI level delay the
+  TX edges (RX is measured from the captured edge, and only needs to hit the middle of a bit).
+
+  The timer is TCE0 with event channel 6 by default.  'tone()', softPWM and 'Serial.beginAuto()'
+  use TCE0 as well, so not at the same time - 'begin()' and 'listen()' fail while one of them
+  has claimed it, and they can't have it until the last SoftwareSerial calls 'end()'.  Define
+  SOFTSERIAL_TIMER and the rest (see SoftwareSerial.cpp) in 'pins_arduino.h' to use another
+  TC0_t.
+
+  Only one SoftwareSerial runs at a time.  'listen()' switches, bytes written to a port that
+  is not listening wait in its TX buffer until it is.
+
+  Usage:
+    SoftwareSerial gps(2, 3); // RX, TX
+    gps.begin(38400);
+    ...
+    while(gps.available())
+    {
+      c = gps.read();
+      ...
+    }
+*/
+
+#ifndef _SOFTWARE_SERIAL_H_INCLUDED
+#define _SOFTWARE_SERIAL_H_INCLUDED
+
+#include <Arduino.h>
+
+#ifndef SOFTSERIAL_RX_BUFFER_SIZE
+#define SOFTSERIAL_RX_BUFFER_SIZE 64 /* power of 2, at most 256 */
+#endif // SOFTSERIAL_RX_BUFFER_SIZE
+#ifndef SOFTSERIAL_TX_BUFFER_SIZE
+#define SOFTSERIAL_TX_BUFFER_SIZE 64 /* power of 2, at most 256 */
+#endif // SOFTSERIAL_TX_BUFFER_SIZE
+
+#define SOFTSERIAL_MAX_BAUD 57600
+
+
+class SoftwareSerial : public Stream
+{
+public:
+  SoftwareSerial(uint8_t rxPin, uint8_t txPin, bool inverse = false);
+  ~SoftwareSerial();
+
+  // returns 'false' if the baud rate is out of range, a pin is not on PORTA-PORTF,
+  // or the timer is in use by somebody else.  It starts listening
+  bool begin(unsigned long baud);
+  void end(void);
+
+  bool listen(void); // make this the running port - returns 'true' if it was not
+  bool isListening(void);
+  bool overflow(void); // 'true' once after a byte was lost because the RX buffer was full
+  unsigned int framingErrors(bool bClear = false);
+
+  virtual int available(void);
+  virtual int peek(void);
+  virtual int read(void);
+  virtual void flush(void); // waits until everything is sent
+  virtual size_t write(uint8_t c);
+  using Print::write;
+  operator bool() { return true; }
+
+  // called by the timer interrupts - not for use by sketches
+  void rx_start(uint16_t wEdge);
+  void rx_bit(void);
+  void tx_bit(void);
+
+protected:
+  PORT_t *_rx_port, *_tx_port;
+  uint8_t _rx_mask, _tx_mask;      // pin bits
+  uint8_t _rx_pin, _tx_pin;        // Arduino pin numbers
+  uint8_t _inverse;
+  uint16_t _bit_time;              // timer counts per bit, 0 before 'begin()'
+
+  uint8_t _rx_state;               // 0 start bit, 1-8 data bits, 9 stop bit
+  uint8_t _rx_data;
+  uint8_t _tx_state;               // 0-7 data bits, 8 stop bit, 9 stop bit done
+  uint8_t _tx_data;
+  volatile uint8_t _tx_busy;       // 1 until the TX buffer is empty and the last stop bit is out
+
+  uint8_t _rx_buf[SOFTSERIAL_RX_BUFFER_SIZE];
+  uint8_t _tx_buf[SOFTSERIAL_TX_BUFFER_SIZE];
+  volatile uint8_t _rx_head, _rx_tail;
+  volatile uint8_t _tx_head, _tx_tail;
+  volatile uint8_t _overflow;
+  volatile unsigned int _framing;
+
+  bool start(void);
+  void stop(void);
+  void rx_idle(void);
+  void tx_next(void);
+};
+
+#endif // _SOFTWARE_SERIAL_H_INCLUDED
@@ -0,0 +1,51 @@
+/*
+  SoftwareSerial Bridge
+
+  Passes everything between 'Serial' and a software serial port on pins 2 (RX)
+  and 3 (TX), both ways at the same time.  Framing errors and lost bytes on the
+  software port are reported once a second.
+*/
+
+#include <SoftwareSerial.h>
+
+SoftwareSerial port(2, 3); // RX, TX
+
+unsigned long last = 0;
+
+void setup()
+{
+  Serial.begin(115200);
+
+  if(!port.begin(57600))
+  {
+    Serial.println("SoftwareSerial: timer in use, or bad pin");
+  }
+}
+
+void loop()
+{
+  while(port.available())
+  {
+    Serial.write(port.read());
+  }
+
+  while(Serial.available())
+  {
+    port.write(Serial.read());
+  }
+
+  if(millis() - last >= 1000)
+  {
+    last = millis();
+
+    if(port.overflow())
+    {
+      Serial.println("SoftwareSerial: RX buffer overflow");
+    }
+
+    if(port.framingErrors(true))
+    {
+      Serial.println("SoftwareSerial: framing errors");
+    }
+  }
+}
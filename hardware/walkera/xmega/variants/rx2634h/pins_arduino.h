@@ -76,6 +76,9 @@
   CTS high to low transition causes an interrupt that may result
   in serial I/O (for faster response time).
 
+  Any serial port can also use RTS/CTS on any pin, set at run time
+  with 'Serial.setFlowControl()' after 'begin()'.
+
   // RTS(DTR) as GPIO 6 (port D pin 6)
   #define SERIAL_0_RTS_PORT_NAME PORTD
   #define SERIAL_0_RTS_PIN_INDEX 6
@@ -243,6 +246,7 @@
 #define SERIAL_0_USART_DATA			    USARTE0_DATA
 #define SERIAL_0_RXC_ISR			      ISR(USARTE0_RXC_vect)
 #define SERIAL_0_DRE_ISR			      ISR(USARTE0_DRE_vect)
+#define SERIAL_0_TXC_ISR			      ISR(USARTE0_TXC_vect)
 // the pin number on the port, not the mapped digital pin number
 #define SERIAL_0_RX_PIN_INDEX		    2
 // the pin number on the port, not the mapped digital pin number
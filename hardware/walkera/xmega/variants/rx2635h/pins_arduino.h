@@ -76,6 +76,9 @@
   CTS high to low transition causes an interrupt that may result 
   in serial I/O (for faster response time).
 
+  Any serial port can also use RTS/CTS on any pin, set at run time
+  with 'Serial.setFlowControl()' after 'begin()'.
+
   // RTS(DTR) as GPIO 6 (port D pin 6)
   #define SERIAL_0_RTS_PORT_NAME PORTD
   #define SERIAL_0_RTS_PIN_INDEX 6
@@ -243,6 +246,7 @@
 #define SERIAL_0_USART_DATA			USARTD1_DATA
 #define SERIAL_0_RXC_ISR			ISR(USARTD1_RXC_vect)
 #define SERIAL_0_DRE_ISR			ISR(USARTD1_DRE_vect)
+#define SERIAL_0_TXC_ISR			ISR(USARTD1_TXC_vect)
 // define THIS to re-map the pins from PD6-7 to PC6-7
 //#define SERIAL_0_REMAP			PORTD_REMAP 
 // the bit needed to remap the port if SERIAL_0_REMAP is defined
@@ -259,6 +263,7 @@
 #define SERIAL_1_USART_DATA			USARTC0_DATA
 #define SERIAL_1_RXC_ISR			ISR(USARTC0_RXC_vect)
 #define SERIAL_1_DRE_ISR			ISR(USARTC0_DRE_vect)
+#define SERIAL_1_TXC_ISR			ISR(USARTC0_TXC_vect)
 // define THIS to re-map the pins from PC6-7 to PE2-3
 //#define SERIAL_1_REMAP			PORTC_REMAP
 // the bit needed to remap the port if SERIAL_1_REMAP